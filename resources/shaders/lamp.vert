@@ -0,0 +1,22 @@
+#version 440 core
+// Lamp vertex shader
+
+layout (location = 0) in vec3 position; // VAP position 0 for vertex position data
+
+//Uniform / Global variables for the  transform matrices
+uniform mat4 model;
+
+// Per-frame camera and light data, shared by every program through one uniform buffer
+layout (std140, binding = 0) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec4 viewPosition;
+    vec4 lightPos[4]; // MAX_FRAME_LIGHTS entries
+    vec4 lightColor[4];
+};
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+}
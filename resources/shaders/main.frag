@@ -0,0 +1,61 @@
+// Main pass fragment shader, appended to material_array.glsl or material_bindless.glsl
+
+in vec3 vertexNormal; // For incoming normals
+in vec3 vertexFragmentPos; // For incoming fragment position
+in vec2 vertexTextureCoordinate;
+flat in uint vertexMaterial;
+
+out vec4 fragmentColor; // For outgoing cube color to the GPU
+
+// Per-frame camera and light data, shared by every program through one uniform buffer
+layout (std140, binding = 0) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec4 viewPosition;
+    vec4 lightPos[4]; // MAX_FRAME_LIGHTS entries
+    vec4 lightColor[4];
+};
+
+uniform vec2 uvScale;
+
+void main()
+{
+    /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
+    // Strengths come from the material table, the features from the defines of the variant
+    MaterialData material = materials[vertexMaterial];
+
+    vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
+    vec3 viewDir = normalize(viewPosition.xyz - vertexFragmentPos); // Calculate view direction
+    vec3 lighting = vec3(0.0f);
+    for (int light = 0; light < LIGHT_COUNT; ++light)
+    {
+        //Calculate Ambient lighting*/
+        vec3 ambient = material.ambientStrength * lightColor[light].rgb; // Generate ambient light color
+
+        //Calculate Diffuse lighting*/
+        vec3 lightDirection = normalize(lightPos[light].xyz - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
+        float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
+        vec3 diffuse = impact * lightColor[light].rgb; // Generate diffuse light color
+        lighting += ambient + diffuse;
+
+        //Calculate Specular lighting*/
+        if (SPECULAR != 0)
+        {
+            vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
+            //Calculate specular component
+            float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), material.highlightSize);
+            lighting += material.specularIntensity * specularComponent * lightColor[light].rgb;
+        }
+    }
+
+    // Texture holds the color to be used for all three components, untextured variants use the material color
+    vec4 surfaceColor = material.color;
+    if (TEXTURED != 0)
+        surfaceColor *= sampleMaterial(vertexMaterial, vertexTextureCoordinate * uvScale);
+
+    // Calculate phong result
+    vec3 phong = lighting * surfaceColor.xyz;
+
+    fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
+}
@@ -0,0 +1,50 @@
+#version 440 core
+// Main pass vertex shader. ShaderVariants defines TEXTURED, SPECULAR and LIGHT_COUNT after the version line
+
+layout (location = 0) in vec3 position; // VAP position 0 for vertex position data
+layout (location = 1) in vec3 normal; // VAP position 1 for normals
+layout (location = 2) in vec2 textureCoordinate;
+layout (location = 3) in uint drawId; // Index of the object: the command's baseInstance plus the instance number
+
+out vec3 vertexNormal; // For outgoing normals to fragment shader
+out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
+out vec2 vertexTextureCoordinate;
+flat out uint vertexMaterial; // Index of the object's material in the material table
+
+// Per-object data written by the batch renderer
+struct ObjectData
+{
+    mat4 model;
+    mat3 normalMatrix; // Inverse transpose of the model matrix, computed on the CPU when the transform changes
+    uint material;
+};
+layout (std430, binding = 0) readonly buffer Objects
+{
+    ObjectData objects[];
+};
+
+// Per-frame camera and light data, shared by every program through one uniform buffer
+layout (std140, binding = 0) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec4 viewPosition;
+    vec4 lightPos[4]; // MAX_FRAME_LIGHTS entries
+    vec4 lightColor[4];
+};
+
+void main()
+{
+    // Every object is drawn by the batch renderer, read the object of this instance from its buffer
+    mat4 objectModel = objects[drawId].model;
+    mat3 objectNormalMatrix = objects[drawId].normalMatrix;
+    uint objectMaterial = objects[drawId].material;
+
+    gl_Position = projection * view * objectModel * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+
+    vertexFragmentPos = vec3(objectModel * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+
+    vertexNormal = objectNormalMatrix * normal; // get normal vectors in world space only and exclude normal translation properties
+    vertexTextureCoordinate = textureCoordinate;
+    vertexMaterial = objectMaterial;
+}
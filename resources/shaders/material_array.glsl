@@ -0,0 +1,34 @@
+#version 440 core
+// Material lookup through the texture array, main.frag is appended to it
+
+struct MaterialData
+{
+    uvec2 handle;
+    uint layer;
+    uint sampler;
+    vec4 color;
+    float ambientStrength;
+    float specularIntensity;
+    float highlightSize;
+};
+layout (std430, binding = 1) readonly buffer Materials
+{
+    MaterialData materials[];
+};
+
+uniform sampler2DArray uMaterialTextures; // Every material texture, one per layer
+
+// The array is sampled through one repeating sampler, so the material's wrap mode (the SamplerWrap order) is
+// applied here. Gradients of the unwrapped coordinates keep the mip level and anisotropy steady across seams
+vec4 sampleMaterial(uint material, vec2 uv)
+{
+    vec2 wrapped = fract(uv);
+    if (materials[material].sampler == 1u)
+        wrapped = 1.0 - abs(mod(uv, 2.0) - 1.0);
+    else if (materials[material].sampler == 2u)
+    {
+        vec2 halfTexel = 0.5 / vec2(textureSize(uMaterialTextures, 0).xy);
+        wrapped = clamp(uv, halfTexel, 1.0 - halfTexel);
+    }
+    return textureGrad(uMaterialTextures, vec3(wrapped, float(materials[material].layer)), dFdx(uv), dFdy(uv));
+}
@@ -0,0 +1,24 @@
+#version 440 core
+#extension GL_ARB_bindless_texture : require
+// Material lookup through bindless handles, main.frag is appended to it
+
+struct MaterialData
+{
+    uvec2 handle;
+    uint layer;
+    uint sampler;
+    vec4 color;
+    float ambientStrength;
+    float specularIntensity;
+    float highlightSize;
+};
+layout (std430, binding = 1) readonly buffer Materials
+{
+    MaterialData materials[];
+};
+
+// The handle already pairs the texture with the sampler of the material
+vec4 sampleMaterial(uint material, vec2 uv)
+{
+    return texture(sampler2D(materials[material].handle), uv);
+}
@@ -1,9 +1,18 @@
 #include <iostream>         // cout, cerr
 #include <cstdlib>          // EXIT_FAILURE
+#include <cstdio>           // frame files written in headless mode
+#include <cstring>          // strcmp for the command line
+#include <cmath>            // fmodf along the benchmark path
+#include <algorithm>        // sort of benchmark frame times
+#include <mutex>            // input shared with the simulation thread
+#include <thread>           // sleep_for while textures stream in
+#include <chrono>           // milliseconds
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>      // Image loading Utility functions
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h> // PNG encoding of captured frames
 
 // GLM Math Header inclusions
 #include <glm/glm.hpp>
@@ -12,13 +21,30 @@
 
 #include <learnOpengl/camera.h> // Camera class
 
+#include "scene.h"          // Scene graph
+#include "meshbuilder.h"    // Indexed mesh generation
+#include "meshpool.h"       // Shared vertex/index arena
+#include "batchrenderer.h"  // Multi-draw-indirect submission
+#include "shaderprogram.h"  // Uniform reflection and per-frame uniform buffer
+#include "glstate.h"        // Redundant state change filtering
+#include "renderqueue.h"    // Draw ordering by state and depth
+#include "textureloader.h"  // Background texture decoding and streamed uploads
+#include "materialtable.h"  // Texture array / bindless materials
+#include "texturecache.h"   // Texture sharing and memory budget
+#include "samplers.h"       // Shared sampler objects
+#include "programcache.h"   // Program binaries kept across runs
+#include "shadervariants.h" // Programs specialized per feature mask
+#include "shaderreloader.h" // Shader files rebuilt when they change
+#include "rendertarget.h"   // Offscreen framebuffer for headless rendering
+#include "camerapath.h"     // Scripted camera flights
+#include "framecapture.h"   // Asynchronous frame readback and encoding
+#include "profiler.h"       // CPU and GPU frame timing
+#include "triplebuffer.h"   // Lock-free handoff of simulation snapshots
+#include "simulationthread.h" // Fixed-rate simulation ticks
+#include "jobsystem.h"      // Work-stealing parallel loops
 
-using namespace std; // Standard namespace
 
-/*Shader program Macro*/
-#ifndef GLSL
-#define GLSL(Version, Source) "#version " #Version " core \n" #Source
-#endif
+using namespace std; // Standard namespace
 
 // Unnamed namespace
 namespace
@@ -29,12 +55,56 @@ const char* const WINDOW_TITLE = "Cody Faircloth Final Project"; // Macro for wi
 const int WINDOW_WIDTH = 800;
 const int WINDOW_HEIGHT = 600;
 
-// Stores the GL data relative to a given mesh
+// GPU memory the texture cache may keep before it evicts unused textures
+const size_t TEXTURE_BUDGET_BYTES = 256 * 1024 * 1024;
+// Anisotropic filtering level of the material samplers, 1 for plain trilinear filtering
+const float TEXTURE_ANISOTROPY = 8.0f;
+// Directory holding the program binaries of previous runs
+const char* const PROGRAM_CACHE_DIRECTORY = "shadercache";
+// Frames kept by the profiler, which prints a summary of them every time this many frames have been rendered
+const unsigned PROFILE_HISTORY_FRAMES = 600;
+// Benchmark runs: camera flight, frame counts and the simulated time between frames
+const char* const BENCHMARK_CAMERA_PATH = "../../resources/paths/benchmark.path";
+const int BENCHMARK_WARMUP_FRAMES = 60;
+const int BENCHMARK_FRAMES = 300;
+const float BENCHMARK_TIMESTEP = 1.0f / 60.0f;
+// Seconds the camera takes to fly the benchmark path once, longer runs fly it again
+const float BENCHMARK_PATH_DURATION = 5.0f;
+const char* const BENCHMARK_RESULTS = "benchmark.json";
+// Simulation ticks per second, independent of the frame rate
+const float SIMULATION_TICK_RATE = 120.0f;
+// Camera movement speed change per scroll wheel notch, and its limits
+const float CAMERA_SPEED_STEP = 0.25f;
+const float CAMERA_SPEED_MIN = 0.25f;
+const float CAMERA_SPEED_MAX = 10.0f;
+// Scene nodes culled, queued or recorded per job, passes this small stay on the render thread
+const size_t JOB_CHUNK_SIZE = 1024;
+// Shader files, rebuilt and swapped in while running when they are saved
+const char* const MAIN_VERTEX_SHADER = "../../resources/shaders/main.vert";
+const char* const MAIN_FRAGMENT_SHADER = "../../resources/shaders/main.frag";
+const char* const MATERIAL_ARRAY_SHADER = "../../resources/shaders/material_array.glsl";
+const char* const MATERIAL_BINDLESS_SHADER = "../../resources/shaders/material_bindless.glsl";
+const char* const LAMP_VERTEX_SHADER = "../../resources/shaders/lamp.vert";
+const char* const LAMP_FRAGMENT_SHADER = "../../resources/shaders/lamp.frag";
+
+// Slots of the meshes held by GLMesh
+enum MeshId {
+    FILING_CABINET_MESH,
+    DESKTOP_MESH,
+    PC_MESH,
+    KEYBOARD_MESH,
+    MONITOR_MESH,
+    SPEAKER_MESH,
+    DESK_LEG_MESH,
+    MONITOR_STAND_MESH,
+    LAMP_MESH
+};
+
+// Stores the GL data of every mesh
 struct GLMesh
 {
-    GLuint vao[9];         // Handle for the vertex array object
-    GLuint vbo[9];         // Handle for the vertex buffer object
-    GLuint nVertices[9];    // Number of indices of the mesh
+    MeshPool pool;          // Shared vertex/index buffers and VAO holding all the meshes
+    MeshHandle handle[9];   // Sub-allocation of each mesh slot in the pool
 };
 
 // Main GLFW window
@@ -44,11 +114,69 @@ GLMesh gMesh;
 // Texture
 GLuint deskTextureId, monitorTextureId, pcTextureId, filingCabinetTextureId, speakerTextureId, keyboardTextureId;
 glm::vec2 gUVScale(1.0f, 1.0f);
+// Objects drawn by the main pass
+Scene gScene;
+// Worker threads splitting culling and command recording of the main pass
+JobSystem gJobs;
+// Nodes that passed frustum culling and their queue items, one list per job chunk
+std::vector<std::vector<uint32_t>> gChunkVisible;
+std::vector<std::vector<RenderItem>> gChunkItems;
+// Draw commands of the main pass, one list per job chunk of the sorted queue
+std::vector<CommandList> gCommandLists;
+// Shader variant drawing each material, resolved on the render thread every frame
+std::vector<GLuint> gMaterialPrograms;
+// Draws of the frame, sorted by state and depth before submission
+RenderQueue gRenderQueue;
+// Draw commands and per-object data of the main pass
+BatchRenderer gBatch;
+// Wrap mode of the scene materials
 GLint gTexWrapMode = GL_REPEAT;
 
-// Shader programs
-GLuint gProgramId;
-GLuint gLampProgramId;
+// Shader programs: the main pass is specialized per material features
+ShaderVariants gVariants;
+ShaderProgram gLampProgram;
+// Feature mask of each scene material
+std::vector<uint32_t> gMaterialFeatures;
+// Linked program binaries reused across runs
+ProgramCache gProgramCache;
+// Rebuilds the programs when their files change, and the keys telling its reloads apart
+ShaderReloader gShaderReloader;
+int gMainPassShaders = -1;
+int gLampShaders = -1;
+// Camera and light data uploaded once per frame
+UniformBuffer<FrameData> gFrameUniforms;
+// Filters out redundant binds and state changes issued while rendering
+GLStateCache gState;
+// Decodes textures on worker threads and uploads them as they become ready
+TextureLoader gTextureLoader;
+// Filtering and wrapping shared by every material texture
+SamplerSet gSamplers;
+// Textures of every material, reachable from a single draw
+MaterialTable gMaterials;
+// Shares textures by path and evicts unused ones when over budget
+TextureCache gTextureCache;
+
+// Headless mode renders gFrameCount frames along gCameraPath into gRenderTarget and captures them to
+// gOutputDirectory instead of opening a window. 0 frames means the default of the mode
+bool gHeadless = false;
+int gFrameCount = 0;
+CameraPath gCameraPath;
+std::string gOutputDirectory = ".";
+RenderTarget gRenderTarget;
+// Rendered frames are read back and encoded in the background when capturing, always in headless mode
+bool gCapturing = false;
+CaptureFormat gCaptureFormat = CAPTURE_PNG;
+FrameCapture gCapture;
+// Times the passes of every frame when profiling, the trace of the last frames is written to gProfileTrace on exit
+bool gProfiling = false;
+std::string gProfileTrace;
+FrameProfiler gProfiler;
+// Benchmark mode replays gCameraPath as camera input at a fixed timestep, renders gWarmupFrames and then
+// gFrameCount measured frames, and writes the measurements to gBenchmarkResults
+bool gBenchmark = false;
+bool gSplinePath = false;
+int gWarmupFrames = BENCHMARK_WARMUP_FRAMES;
+std::string gBenchmarkResults = BENCHMARK_RESULTS;
 
 // camera
 Camera gCamera(glm::vec3(0.0f, 0.0f, 5.0f));
@@ -56,13 +184,50 @@ float gLastX = WINDOW_WIDTH / 2.0f;
 float gLastY = WINDOW_HEIGHT / 2.0f;
 bool gFirstMouse = true;
 bool viewProjection = true;
-float cameraSpeed = 0.5;
 
-// timing
-float gDeltaTime = 0.0f; // time between current frame and last frame
-float gLastFrame = 0.0f;
+// Keys held down, as gathered on the main thread for the simulation
+enum InputKey {
+    INPUT_FORWARD = 1 << 0,
+    INPUT_BACKWARD = 1 << 1,
+    INPUT_LEFT = 1 << 2,
+    INPUT_RIGHT = 1 << 3,
+    INPUT_UP = 1 << 4,
+    INPUT_DOWN = 1 << 5,
+    INPUT_PERSPECTIVE = 1 << 6,
+    INPUT_ORTHOGRAPHIC = 1 << 7
+};
+
+// Input the simulation hasn't consumed yet: the keys held down, and the mouse motion and scrolling since the last tick
+struct InputState
+{
+    unsigned Keys;
+    float MouseX;
+    float MouseY;
+    float Scroll;
+};
+
+// State published by every simulation tick. Frames draw the camera blended from Previous to Current by how far
+// they are into the tick after the one at Time
+struct SimulationSnapshot
+{
+    CameraKey Previous;
+    CameraKey Current;
+    float Zoom;
+    bool Perspective;
+    double Time;
+};
 
-// Light color, position, and scale
+// The simulation thread moves gSimulationCamera from gInput at a fixed rate and publishes gSimulated through
+// gSnapshots; the render thread draws gCamera set from the newest snapshot
+std::mutex gInputMutex;
+InputState gInput = { 0, 0.0f, 0.0f, 0.0f };
+Camera gSimulationCamera;
+SimulationSnapshot gSimulated;
+TripleBuffer<SimulationSnapshot> gSnapshots;
+SimulationThread gSimulation;
+
+// Light color, position, and scale. Only the first gLightCount of the frame's lights are shaded
+GLuint gLightCount = 1;
 glm::vec3 gLightColor(1.0f, 1.0f, 1.0f);
 glm::vec3 gLightPosition(0.0f, 0.0f, 50.0f);
 glm::vec3 gLightScale(0.5f);
@@ -73,164 +238,85 @@ glm::vec3 gLightScale(0.5f);
  * redraw graphics on the window when resized,
  * and render graphics on the screen
  */
+bool UParseArguments(int argc, char* argv[]);
 bool UInitialize(int, char*[], GLFWwindow** window);
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
+void UStartSimulation();
+void USimulate(double time, float step);
+void UApplySnapshot(double now);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 void UCreateMesh(GLMesh &mesh);
 void UDestroyMesh(GLMesh &mesh);
+void UCreateScene(Scene &scene);
 bool UCreateTexture(const char* filename, GLuint &textureId);
 void UDestroyTexture(GLuint textureId);
 void URender();
+void UUpdateTextures();
+bool URenderFrames();
+bool UFinishCapture();
+bool UFinishProfile();
+bool URunBenchmark();
+void UWaitForTextures();
+void UReplayCameraKey(const CameraKey &key);
+bool UWriteBenchmarkResults(int width, int height, double drawCalls, double triangles, double objects);
+void UApplyCameraKey(const CameraKey &key);
 bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint &programId);
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, ShaderProgram &program);
+void UDeleteFailedProgram(GLuint &programId, GLuint vertexShaderId, GLuint fragmentShaderId);
+void USetupVariantProgram(ShaderProgram &program);
+bool UReadShaderFiles(const std::vector<std::string> &filenames, std::string &source);
+void USwapReloadedShaders();
+uint32_t UMaterialFeatures(const Material &material);
 void UDestroyShaderProgram(GLuint programId);
 
 
-/* Vertex Shader Source Code*/
-const GLchar * vertexShaderSource = GLSL(440,
-
-    layout (location = 0) in vec3 position; // VAP position 0 for vertex position data
-    layout (location = 1) in vec3 normal; // VAP position 1 for normals
-    layout (location = 2) in vec2 textureCoordinate;
-
-    out vec3 vertexNormal; // For outgoing normals to fragment shader
-    out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
-    out vec2 vertexTextureCoordinate;
-
-    //Uniform / Global variables for the  transform matrices
-    uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
-
-    void main()
-    {
-        gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
-
-        vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
-
-        vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
-        vertexTextureCoordinate = textureCoordinate;
-    }
-);
-
-
-/* Fragment Shader Source Code*/
-const GLchar * fragmentShaderSource = GLSL(440,
-
-    in vec3 vertexNormal; // For incoming normals
-    in vec3 vertexFragmentPos; // For incoming fragment position
-    in vec2 vertexTextureCoordinate;
-
-    out vec4 fragmentColor; // For outgoing cube color to the GPU
-
-    // Uniform / Global variables for object color, light color, light position, and camera/view position
-    uniform vec3 lightColor;
-    uniform vec3 lightPos;
-    uniform vec3 viewPosition;
-    uniform sampler2D uTexture; // Useful when working with multiple textures
-    uniform vec2 uvScale;
-
-    void main()
-    {
-        /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
-
-        //Calculate Ambient lighting*/
-        float ambientStrength = 0.2f; // Set ambient or global lighting strength
-        vec3 ambient = ambientStrength * lightColor; // Generate ambient light color
-
-        //Calculate Diffuse lighting*/
-        vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
-        vec3 lightDirection = normalize(lightPos - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-        float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-        vec3 diffuse = impact * lightColor; // Generate diffuse light color
-
-        //Calculate Specular lighting*/
-        float specularIntensity = 0.2f; // Set specular light strength
-        float highlightSize = 16.0f; // Set specular highlight size
-        vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
-        vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
-        //Calculate specular component
-        float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-        vec3 specular = specularIntensity * specularComponent * lightColor;
-
-        // Texture holds the color to be used for all three components
-        vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
-
-        // Calculate phong result
-        vec3 phong = (ambient + diffuse + specular) * textureColor.xyz;
-
-        fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
-    }
-);
-
-
-/* Lamp Shader Source Code*/
-const GLchar * lampVertexShaderSource = GLSL(440,
-
-    layout (location = 0) in vec3 position; // VAP position 0 for vertex position data
-
-        //Uniform / Global variables for the  transform matrices
-    uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
-
-    void main()
-    {
-        gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
-    }
-);
-
-
-/* Fragment Shader Source Code*/
-const GLchar * lampFragmentShaderSource = GLSL(440,
-
-    out vec4 fragmentColor; // For outgoing lamp color (smaller cube) to the GPU
-
-    void main()
-    {
-        fragmentColor = vec4(1.0f); // Set color to white (1.0f,1.0f,1.0f) with alpha 1.0
-    }
-);
-
-
-// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
-void flipImageVertically(unsigned char *image, int width, int height, int channels)
-{
-    for (int j = 0; j < height / 2; ++j)
-    {
-        int index1 = j * width * channels;
-        int index2 = (height - 1 - j) * width * channels;
-
-        for (int i = width * channels; i > 0; --i)
-        {
-            unsigned char tmp = image[index1];
-            image[index1] = image[index2];
-            image[index2] = tmp;
-            ++index1;
-            ++index2;
-        }
-    }
-}
-
-
 int main(int argc, char* argv[])
 {
+    if (!UParseArguments(argc, argv))
+        return EXIT_FAILURE;
+
     if (!UInitialize(argc, argv, &gWindow))
         return EXIT_FAILURE;
 
+    // Start the workers before any frame is recorded
+    gJobs.Start();
+    cout << "INFO: Recording draws on " << gJobs.ThreadCount() << " threads" << endl;
+
     // Create the mesh
     UCreateMesh(gMesh); // Calls the function to create the Vertex Buffer Object
 
-    // Create the shader programs
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
+    // Material textures are either bindless or packed in an array, the fragment shader is put together to match
+    gSamplers.Create(TEXTURE_ANISOTROPY);
+    gMaterials.Create(16, gSamplers);
+    ShaderReloader::Source mainShaders, lampShaders;
+    mainShaders.VertexFiles.push_back(MAIN_VERTEX_SHADER);
+    mainShaders.FragmentFiles.push_back(gMaterials.Bindless() ? MATERIAL_BINDLESS_SHADER : MATERIAL_ARRAY_SHADER);
+    mainShaders.FragmentFiles.push_back(MAIN_FRAGMENT_SHADER);
+    lampShaders.VertexFiles.push_back(LAMP_VERTEX_SHADER);
+    lampShaders.FragmentFiles.push_back(LAMP_FRAGMENT_SHADER);
+
+    string mainVertexSource, mainFragmentSource, lampVertexSource, lampFragmentSource;
+    if (!UReadShaderFiles(mainShaders.VertexFiles, mainVertexSource) || !UReadShaderFiles(mainShaders.FragmentFiles, mainFragmentSource) ||
+        !UReadShaderFiles(lampShaders.VertexFiles, lampVertexSource) || !UReadShaderFiles(lampShaders.FragmentFiles, lampFragmentSource))
         return EXIT_FAILURE;
 
-    if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampProgramId))
+    // Create the shader programs, from the binaries of an earlier run when the sources and driver haven't changed.
+    // The main pass is specialized per feature mask once the scene's materials are known
+    gProgramCache.Create(PROGRAM_CACHE_DIRECTORY);
+    gVariants.Create(mainVertexSource, mainFragmentSource, UCreateShaderProgram, USetupVariantProgram);
+
+    if (!UCreateShaderProgram(lampVertexSource.c_str(), lampFragmentSource.c_str(), gLampProgram))
         return EXIT_FAILURE;
 
-    // Load textures
+    // Per-frame data is written once into a uniform buffer read by both programs
+    gFrameUniforms.Create(FRAME_UNIFORM_BINDING);
+
+    // Load textures. Every texture shows a placeholder until its image has been decoded in the background
+    gTextureLoader.Start();
+    gTextureCache.Create(gTextureLoader, TEXTURE_BUDGET_BYTES);
     const char* fileCabinetTexFilename = "../../resources/textures/filecabinetfront.jpeg";
     const char* pcTexFilename = "../../resources/textures/PCTexture.jpg";
     const char* monitorTexFilename = "../../resources/textures/MonitorTexture.png";
@@ -268,50 +354,212 @@ int main(int argc, char* argv[])
         cout << "Failed to load texture " << keyboardTexFilename << endl;
         return EXIT_FAILURE;
     }
-    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gProgramId);
-    // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gProgramId, "uTexture"), 0);
+    // Place the objects of the scene
+    UCreateScene(gScene);
+    gBatch.Create(gMesh.pool, (GLuint)gScene.Nodes.size());
+
+    // Scene materials map one to one onto the material table. Baked textures are already final
+    for (size_t i = 0; i < gScene.Materials.size(); ++i)
+    {
+        const Material &material = gScene.Materials[i];
+        GLuint index = gMaterials.Add(material.TextureId, SamplerWrapFor(material.WrapMode));
+        gMaterials.SetShading(index, material.Color, material.AmbientStrength, material.SpecularIntensity, material.HighlightSize);
+        if (!gTextureLoader.IsPending(material.TextureId))
+            gMaterials.Refresh(material.TextureId, gState);
+
+        // Build the variant every material needs now rather than in the middle of a frame
+        gMaterialFeatures.push_back(UMaterialFeatures(material));
+        if (!gVariants.Get(gMaterialFeatures.back()))
+            return EXIT_FAILURE;
+    }
+    cout << "INFO: " << gVariants.Count() << " shader variants, " << gProgramCache.Hits() << " programs loaded from binaries, " << gProgramCache.Misses() << " compiled" << endl;
+
+    // Watch the shader files. Rebuilds happen on a hidden window whose context shares objects with the main one.
+    // Batch runs don't edit shaders, so headless and benchmark runs go without
+    if (!gHeadless && !gBenchmark)
+    {
+        // every variant the materials use was built above, so the masks are complete
+        mainShaders.Masks = gVariants.Masks();
+        gMainPassShaders = gShaderReloader.Watch(mainShaders);
+        gLampShaders = gShaderReloader.Watch(lampShaders);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        gShaderReloader.Start(glfwCreateWindow(1, 1, WINDOW_TITLE, NULL, gWindow), UCreateShaderProgram);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    }
 
     // Sets the background color of the window to black (it will be implicitely used by glClear)
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(gWindow))
+    // Setup bound programs, textures and buffers directly, so start rendering from an unknown state
+    gState.Invalidate();
+
+    // benchmarks keep exactly their measured frames
+    if (gProfiling || gBenchmark)
+        gProfiler.Create(gBenchmark ? gFrameCount : PROFILE_HISTORY_FRAMES);
+
+    int status = EXIT_SUCCESS;
+    if (gBenchmark)
+    {
+        // replay the camera path and measure the frames
+        if (!URunBenchmark())
+            status = EXIT_FAILURE;
+    }
+    else if (gHeadless)
+    {
+        // render the requested frames offscreen and write them out
+        if (!URenderFrames())
+            status = EXIT_FAILURE;
+    }
+    else
     {
-        // per-frame timing
-        // --------------------
-        float currentFrame = glfwGetTime();
-        gDeltaTime = currentFrame - gLastFrame;
-        gLastFrame = currentFrame;
+        // capture what the window shows, which can't be resized while capturing
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+        if (gCapturing)
+            gCapture.Start(framebufferWidth, framebufferHeight, gCaptureFormat, gOutputDirectory);
+
+        // camera and input are simulated on their own thread from here on
+        UStartSimulation();
+
+        // render loop
+        // -----------
+        while (!glfwWindowShouldClose(gWindow))
+        {
+            gProfiler.BeginFrame();
 
-        // input
-        // -----
-        UProcessInput(gWindow);
+            // input
+            // -----
+            UProcessInput(gWindow);
 
-        // Render this frame
-        URender();
+            // take the camera from the newest simulation tick
+            UApplySnapshot(gSimulation.Now());
+
+            // swap in shaders rebuilt since the last frame
+            USwapReloadedShaders();
+
+            // upload the textures that finished decoding since the last frame and hand them to their materials
+            UUpdateTextures();
+
+            // Render this frame
+            URender();
 
-        glfwPollEvents();
+            glfwPollEvents();
+
+            gProfiler.EndFrame();
+            if (gProfiler.Enabled() && gProfiler.FrameIndex() % PROFILE_HISTORY_FRAMES == 0)
+                gProfiler.Summary(cout);
+        }
+        gSimulation.Stop();
+
+        if (gCapturing && !UFinishCapture())
+            status = EXIT_FAILURE;
     }
 
+    if (gProfiling && !UFinishProfile())
+        status = EXIT_FAILURE;
+
+    // Report how many state changes were filtered out
+    gState.Report(cout);
+
+    gJobs.Stop();
+
     // Release mesh data
+    gBatch.Destroy();
     UDestroyMesh(gMesh);
 
     // Release texture
+    gTextureLoader.Stop();
+    gMaterials.Destroy();
+    gSamplers.Destroy();
     UDestroyTexture(deskTextureId);
     UDestroyTexture(monitorTextureId);
     UDestroyTexture(pcTextureId);
     UDestroyTexture(filingCabinetTextureId);
     UDestroyTexture(speakerTextureId);
     UDestroyTexture(keyboardTextureId);
+    gTextureCache.Clear(gState);
 
     // Release shader programs
-    UDestroyShaderProgram(gProgramId);
-    UDestroyShaderProgram(gLampProgramId);
+    gShaderReloader.Stop();
+    gVariants.Destroy();
+    UDestroyShaderProgram(gLampProgram.Id);
+    gFrameUniforms.Destroy();
+
+    exit(status); // Terminates the program
+}
 
-    exit(EXIT_SUCCESS); // Terminates the program successfully
+
+// Reads the command line. Without options the scene opens in a window; with --headless it is rendered offscreen:
+//   --headless            render without a window or display
+//   --frames N            number of frames to render, 1 by default
+//   --camera-path FILE    camera keys flown over the frames (see CameraPath), the default view otherwise
+//   --output DIR          existing directory receiving frame_00000.png, frame_00001.png, ...
+//   --capture png|yuv     capture frames, also when rendering to the window. yuv pipes raw I420 frames to stdout
+//   --profile FILE        time every frame, print summaries and write a Chrome trace of the last frames to FILE
+// With --benchmark the camera path is replayed as input at a fixed timestep, windowed or headless, and measured:
+//   --benchmark           run the benchmark, 300 measured frames by default
+//   --warmup N            frames rendered before measuring, 60 by default
+//   --spline              fly a Catmull-Rom curve through the camera keys instead of straight lines
+//   --results FILE        JSON file receiving the measurements, benchmark.json by default
+bool UParseArguments(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--headless") == 0)
+            gHeadless = true;
+        else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+        {
+            gFrameCount = atoi(argv[++i]);
+            if (gFrameCount < 1)
+            {
+                cout << "ERROR::ARGUMENTS::FRAME_COUNT must be at least 1" << endl;
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "--benchmark") == 0)
+            gBenchmark = true;
+        else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+            gWarmupFrames = std::max(atoi(argv[++i]), 0);
+        else if (strcmp(argv[i], "--spline") == 0)
+            gSplinePath = true;
+        else if (strcmp(argv[i], "--results") == 0 && hasValue)
+            gBenchmarkResults = argv[++i];
+        else if (strcmp(argv[i], "--camera-path") == 0 && hasValue)
+        {
+            if (!gCameraPath.Load(argv[++i]))
+                return false;
+        }
+        else if (strcmp(argv[i], "--output") == 0 && hasValue)
+            gOutputDirectory = argv[++i];
+        else if (strcmp(argv[i], "--capture") == 0 && hasValue && (strcmp(argv[i + 1], "png") == 0 || strcmp(argv[i + 1], "yuv") == 0))
+        {
+            gCapturing = true;
+            gCaptureFormat = strcmp(argv[++i], "yuv") == 0 ? CAPTURE_YUV : CAPTURE_PNG;
+        }
+        else if (strcmp(argv[i], "--profile") == 0 && hasValue)
+        {
+            gProfiling = true;
+            gProfileTrace = argv[++i];
+        }
+        else
+        {
+            cout << "Usage: " << argv[0] << " [--headless] [--frames N] [--camera-path FILE] [--output DIR] [--capture png|yuv] [--profile FILE]" << endl;
+            cout << "       " << argv[0] << " --benchmark [--headless] [--frames N] [--warmup N] [--camera-path FILE] [--spline] [--results FILE]" << endl;
+            return false;
+        }
+    }
+    if (gFrameCount == 0)
+        gFrameCount = gBenchmark ? BENCHMARK_FRAMES : 1;
+    if (gBenchmark && gCameraPath.Empty() && !gCameraPath.Load(BENCHMARK_CAMERA_PATH))
+        return false;
+    // headless renders exist to be written out, benchmarks only capture when asked to
+    if (gHeadless && !gBenchmark)
+        gCapturing = true;
+    // stdout carries the video stream, messages go to stderr instead
+    if (gCapturing && gCaptureFormat == CAPTURE_YUV)
+        cout.rdbuf(std::cerr.rdbuf());
+    return true;
 }
 
 
@@ -320,6 +568,12 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 {
     // GLFW: initialize and configure
     // ------------------------------
+    // Headless runs have no display: GLFW's null platform (GLFW 3.4) creates contexts through EGL or OSMesa,
+    // which Mesa's llvmpipe provides without a GPU
+#ifdef GLFW_PLATFORM_NULL
+    if (gHeadless)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
@@ -331,7 +585,28 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 
     // GLFW: window creation
     // ---------------------
+    if (gHeadless)
+    {
+        // the window only carries the context, frames are drawn into gRenderTarget
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef GLFW_EGL_CONTEXT_API
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+#endif
+    }
+    else if (gCapturing)
+    {
+        // the capture ring is sized for the framebuffer once, and a YUV stream can't change size midway
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    }
     *window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
+#ifdef GLFW_OSMESA_CONTEXT_API
+    if (*window == NULL && gHeadless)
+    {
+        // no EGL driver, fall back to Mesa's offscreen software renderer
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+        *window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
+    }
+#endif
     if (*window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -339,19 +614,28 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
         return false;
     }
     glfwMakeContextCurrent(*window);
-    glfwSetFramebufferSizeCallback(*window, UResizeWindow);
-    glfwSetCursorPosCallback(*window, UMousePositionCallback);
-    glfwSetScrollCallback(*window, UMouseScrollCallback);
-    glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
+    // benchmark windows ignore the mouse so that every run sees the same camera
+    if (!gHeadless && !gBenchmark)
+    {
+        glfwSetFramebufferSizeCallback(*window, UResizeWindow);
+        glfwSetCursorPosCallback(*window, UMousePositionCallback);
+        glfwSetScrollCallback(*window, UMouseScrollCallback);
+        glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
 
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
 
     // GLEW: initialize
     // ----------------
     // Note: if using GLEW version 1.13 or earlier
     glewExperimental = GL_TRUE;
     GLenum GlewInitResult = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // a GLX build of GLEW still loads the entry points of an EGL context, it only misses the GLX extensions
+    if (gHeadless && GlewInitResult == GLEW_ERROR_NO_GLX_DISPLAY)
+        GlewInitResult = GLEW_OK;
+#endif
 
     if (GLEW_OK != GlewInitResult)
     {
@@ -369,29 +653,98 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 void UProcessInput(GLFWwindow* window)
 {
-    static const float cameraSpeed = 2.5f;
-
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(BACKWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(LEFT, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(RIGHT, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(UP, cameraSpeed);
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(DOWN, cameraSpeed);
-    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
-        viewProjection = true;
-    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
-        viewProjection = false;
+    // GLFW only reads keys on the main thread, the simulation acts on them at its next tick
+    static const int keys[] = { GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_Q, GLFW_KEY_E, GLFW_KEY_P, GLFW_KEY_O };
+    static const unsigned flags[] = { INPUT_FORWARD, INPUT_BACKWARD, INPUT_LEFT, INPUT_RIGHT, INPUT_UP, INPUT_DOWN, INPUT_PERSPECTIVE, INPUT_ORTHOGRAPHIC };
+    unsigned held = 0;
+    for (int i = 0; i < 8; ++i)
+        if (glfwGetKey(window, keys[i]) == GLFW_PRESS)
+            held |= flags[i];
 
-    
+    std::lock_guard<std::mutex> lock(gInputMutex);
+    gInput.Keys = held;
+}
+
+
+// Starts ticking the simulation from the current camera
+void UStartSimulation()
+{
+    gSimulationCamera = gCamera;
+    CameraKey pose = { gCamera.Position, gCamera.Yaw, gCamera.Pitch };
+    gSimulated.Previous = gSimulated.Current = pose;
+    gSimulated.Zoom = gCamera.Zoom;
+    gSimulated.Perspective = viewProjection;
+    gSimulated.Time = 0.0;
+    gSnapshots.Reset(gSimulated);
+    gSimulation.Start(SIMULATION_TICK_RATE, USimulate);
+}
+
+
+// One simulation tick, on the simulation thread: moves the camera by the input since the last tick and publishes
+// the result. Every key moves the camera for exactly one step, so speeds don't depend on the frame rate
+void USimulate(double time, float step)
+{
+    InputState input;
+    {
+        std::lock_guard<std::mutex> lock(gInputMutex);
+        input = gInput;
+        gInput.MouseX = gInput.MouseY = gInput.Scroll = 0.0f;
+    }
+
+    // scrolling changes how fast the keys move the camera
+    if (input.Scroll != 0.0f)
+    {
+        float speed = gSimulationCamera.MovementSpeed + input.Scroll * CAMERA_SPEED_STEP;
+        gSimulationCamera.MovementSpeed = std::max(CAMERA_SPEED_MIN, std::min(speed, CAMERA_SPEED_MAX));
+    }
+
+    if (input.MouseX != 0.0f || input.MouseY != 0.0f)
+        gSimulationCamera.ProcessMouseMovement(input.MouseX, input.MouseY);
+    if (input.Keys & INPUT_FORWARD)
+        gSimulationCamera.ProcessKeyboard(FORWARD, step);
+    if (input.Keys & INPUT_BACKWARD)
+        gSimulationCamera.ProcessKeyboard(BACKWARD, step);
+    if (input.Keys & INPUT_LEFT)
+        gSimulationCamera.ProcessKeyboard(LEFT, step);
+    if (input.Keys & INPUT_RIGHT)
+        gSimulationCamera.ProcessKeyboard(RIGHT, step);
+    if (input.Keys & INPUT_UP)
+        gSimulationCamera.ProcessKeyboard(UP, step);
+    if (input.Keys & INPUT_DOWN)
+        gSimulationCamera.ProcessKeyboard(DOWN, step);
+    if (input.Keys & INPUT_PERSPECTIVE)
+        gSimulated.Perspective = true;
+    if (input.Keys & INPUT_ORTHOGRAPHIC)
+        gSimulated.Perspective = false;
+
+    CameraKey pose = { gSimulationCamera.Position, gSimulationCamera.Yaw, gSimulationCamera.Pitch };
+    gSimulated.Previous = gSimulated.Current;
+    gSimulated.Current = pose;
+    gSimulated.Zoom = gSimulationCamera.Zoom;
+    gSimulated.Time = time;
+    gSnapshots.Back() = gSimulated;
+    gSnapshots.Publish();
+}
+
+
+// Sets the render camera from the newest snapshot, blended between its two ticks by the time since it was due.
+// Frames are drawn up to one tick behind the simulation but move smoothly at any frame rate
+void UApplySnapshot(double now)
+{
+    gSnapshots.Update();
+    const SimulationSnapshot &snapshot = gSnapshots.Front();
+    float blend = glm::clamp((float)((now - snapshot.Time) / gSimulation.Step()), 0.0f, 1.0f);
+
+    CameraKey key;
+    key.Position = glm::mix(snapshot.Previous.Position, snapshot.Current.Position, blend);
+    key.Yaw = glm::mix(snapshot.Previous.Yaw, snapshot.Current.Yaw, blend);
+    key.Pitch = glm::mix(snapshot.Previous.Pitch, snapshot.Current.Pitch, blend);
+    UApplyCameraKey(key);
+    gCamera.Zoom = snapshot.Zoom;
+    viewProjection = snapshot.Perspective;
 }
 
 
@@ -419,7 +772,10 @@ void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
     gLastX = xpos;
     gLastY = ypos;
 
-    gCamera.ProcessMouseMovement(xoffset, yoffset);
+    // the simulation turns the camera at its next tick
+    std::lock_guard<std::mutex> lock(gInputMutex);
+    gInput.MouseX += xoffset;
+    gInput.MouseY += yoffset;
 }
 
 
@@ -427,10 +783,9 @@ void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
 // ----------------------------------------------------------------------
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    if (yoffset > 0 && cameraSpeed < 0.1f)
-        cameraSpeed += 0.01f;
-    if (yoffset < 0 && cameraSpeed > 0.01f)
-        cameraSpeed -= 0.01f;
+    // the simulation changes the camera speed at its next tick
+    std::lock_guard<std::mutex> lock(gInputMutex);
+    gInput.Scroll += (float)yoffset;
 }
 
 // glfw: handle mouse button events
@@ -476,186 +831,167 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 // Functioned called to render a frame
 void URender()
 {
+    ProfileScope renderScope(gProfiler, "render");
+
+    // Headless frames go to the offscreen target, the window's framebuffer otherwise
+    if (gHeadless)
+        gRenderTarget.Bind();
 
     // Enable z-depth
-    glEnable(GL_DEPTH_TEST);
+    gState.Enable(GL_DEPTH_TEST);
     
     // Clear the frame and z buffers
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    gState.ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 
-    // CUBE: draw cube
-    //----------------
-    // Set the shader to be used
-    glUseProgram(gProgramId);
-
     // camera/view transformation
     glm::mat4 view = gCamera.GetViewMatrix();
 
     // Creates a perspective or ortho view
     glm::mat4 projection;
+    float nearPlane, farPlane;
     if (viewProjection) {
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+        nearPlane = 0.1f;
+        farPlane = 100.0f;
+        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, nearPlane, farPlane);
     }
     else {
         float scale = 120;
-        projection = glm::ortho((800.0f / scale), -(900.0f / scale), -(600.0f / scale), (600.0f / scale), -2.5f, 6.5f);
+        nearPlane = -2.5f;
+        farPlane = 6.5f;
+        projection = glm::ortho((800.0f / scale), -(900.0f / scale), -(600.0f / scale), (600.0f / scale), nearPlane, farPlane);
     }
 
-#pragma region Filing Cabinet Binding / Generation
-    glm::mat4 scale = glm::scale(glm::vec3(1.0f, 1.0f, 0.5f));
-    glm::mat4 rotation = glm::rotate(45.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::mat4 translation = glm::translate(glm::vec3(0.75f, 0.0f, -0.25f));
-    glm::mat4 model = translation * rotation * scale;
-    //Retrieves and passed transform matrices to the shader program
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    //Reference matrix uniforms from the shader program for the color light color light position and camera position
-    GLint objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    GLint lightColorLoc = glGetUniformLocation(gProgramId, "lightColor");
-    GLint keyLightColorLoc = glGetUniformLocation(gProgramId, "keyLightColor");
-    GLint lightPositionLoc = glGetUniformLocation(gProgramId, "lightPos");
-    GLint viewPositionLoc = glGetUniformLocation(gProgramId, "viewPosition");
-
-    //Pass color, light and camera data to the shader programs corresponding uniforms
-    glUniform3f(lightColorLoc, gLightColor.r, gLightColor.g, gLightColor.b);
-    glUniform3f(lightPositionLoc, gLightPosition.x, gLightPosition.y, gLightPosition.z);
-    const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-    GLint UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-    //Activates the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao[0]);
-    //bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, filingCabinetTextureId);
-    //Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[0]);
-#pragma endregion
-
-#pragma region DeskTop Binding / Generation
-    //Bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, deskTextureId);
-    scale = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glBindVertexArray(gMesh.vao[1]);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[1]);
-#pragma endregion
-
-#pragma region PC Binding / Generation
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, pcTextureId);
-    scale = glm::scale(glm::vec3(1.0f, 1.0f, 0.25f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(0.8f, 0.0f, 0.0f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glBindVertexArray(gMesh.vao[2]);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[2]);
-#pragma endregion
+    //Pass transform, light and camera data to every program through the shared uniform buffer
+    FrameData frame;
+    frame.View = view;
+    frame.Projection = projection;
+    frame.ViewPosition = glm::vec4(gCamera.Position, 1.0f);
+    for (GLuint i = 0; i < MAX_FRAME_LIGHTS; ++i)
+    {
+        frame.LightPosition[i] = glm::vec4(gLightPosition, 1.0f);
+        frame.LightColor[i] = glm::vec4(i < gLightCount ? gLightColor : glm::vec3(0.0f), 1.0f);
+    }
+    gFrameUniforms.Update(frame);
 
-#pragma region Keyboard Binding / Generation
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, keyboardTextureId);
-    scale = glm::scale(glm::vec3(1.25f, 1.0f, 1.0f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glBindVertexArray(gMesh.vao[3]);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[3]);
-#pragma endregion
+    // CUBE: draw cube
+    //----------------
+    // Every draw names the shader variant of its material, the batch switches programs between runs
+
+#pragma region Scene Binding / Generation
+    gProfiler.Begin("scene");
+
+    // Only nodes whose transform changed since the last frame get their world matrix rebuilt
+    gScene.UpdateWorldMatrices();
+
+    //Activates the shared VAO, every mesh lives in the same vertex and index buffers
+    gState.BindVertexArray(gMesh.pool.Vao());
+
+    // Queue every object with a key made of its state and view depth, then sort so that materials and meshes are
+    // contiguous (one multi-draw per material, instanced copies) and each group is drawn front to back
+    // Objects whose world box lies outside the view volume are dropped before anything is queued. Every job culls
+    // and keys its own range of nodes, the ranges are joined in order so the queue is the same on any core count
+    Frustum frustum(projection * view);
+    size_t nodeChunks = JobSystem::ChunkCount(gScene.WorldBounds.Size(), JOB_CHUNK_SIZE);
+    gChunkVisible.resize(nodeChunks);
+    gChunkItems.resize(nodeChunks);
+    gJobs.ParallelFor(gScene.WorldBounds.Size(), JOB_CHUNK_SIZE, [&](size_t chunk, size_t begin, size_t end)
+    {
+        std::vector<uint32_t>& visible = gChunkVisible[chunk];
+        std::vector<RenderItem>& items = gChunkItems[chunk];
+        visible.clear();
+        items.clear();
+        frustum.Cull(gScene.WorldBounds, begin, end, visible);
+        for (size_t i = 0; i < visible.size(); ++i)
+        {
+            const SceneNode& node = gScene.Nodes[visible[i]];
+            float viewDepth = -(view * glm::vec4(node.WorldCenter, 1.0f)).z;
+            float depth = (viewDepth - nearPlane) / (farPlane - nearPlane);
+            RenderItem item;
+            item.Key = RenderQueue::MakeKey(PASS_OPAQUE, gMaterialFeatures[node.Material], node.Material, node.Mesh, depth);
+            item.Node = visible[i];
+            items.push_back(item);
+        }
+    });
+    gRenderQueue.Clear();
+    for (size_t chunk = 0; chunk < nodeChunks; ++chunk)
+        gRenderQueue.Items.insert(gRenderQueue.Items.end(), gChunkItems[chunk].begin(), gChunkItems[chunk].end());
+    gRenderQueue.Sort();
+
+    // Looking up a variant may compile it, so programs are resolved here before any job needs them. Materials
+    // whose variant failed to build get program 0 and are skipped
+    gMaterialPrograms.resize(gMaterialFeatures.size());
+    for (size_t i = 0; i < gMaterialFeatures.size(); ++i)
+    {
+        const ShaderProgram* variant = gVariants.Get(gMaterialFeatures[i]);
+        gMaterialPrograms[i] = variant ? variant->Id : 0;
+    }
 
-#pragma region Monitor Binding / Generation
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, monitorTextureId);
-    scale = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glBindVertexArray(gMesh.vao[4]);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[4]);
-#pragma endregion
+    // Record one indirect command plus the model and normal matrices of every object. Each job records its part
+    // of the sorted queue into its own command list and writes the objects straight into mapped memory, at the
+    // queue position of the object, so the render thread only replays the lists
+    gBatch.Begin();
+    size_t queued = gRenderQueue.Items.size();
+    ObjectData* objects = gBatch.MapObjects((GLuint)queued, gState);
+    size_t queueChunks = JobSystem::ChunkCount(queued, JOB_CHUNK_SIZE);
+    gCommandLists.resize(std::max(gCommandLists.size(), queueChunks));
+    gJobs.ParallelFor(queued, JOB_CHUNK_SIZE, [&](size_t chunk, size_t begin, size_t end)
+    {
+        CommandList& list = gCommandLists[chunk];
+        list.Clear();
+        for (size_t i = begin; i < end; ++i)
+        {
+            const SceneNode& node = gScene.Nodes[gRenderQueue.Items[i].Node];
+            if (!gMaterialPrograms[node.Material])
+                continue;
+            BatchRenderer::Record(list, gMesh.pool, gMesh.handle[node.Mesh], node.World, node.Normal, node.Material, gMaterialPrograms[node.Material],
+                (GLuint)i, objects);
+        }
+    });
 
-#pragma region Speaker Binding / Generation
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, speakerTextureId);
-    scale = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(-0.75f, 0.0f, 0.40f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glBindVertexArray(gMesh.vao[5]);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[5]);
-#pragma endregion
+    //every material is reachable from the shader, so the whole pass is one submission
+    gProfiler.Begin("submit");
+    gMaterials.Bind(gState);
+    gBatch.Submit(gCommandLists.data(), queueChunks, gState, gMesh.pool.IndexType());
+    gProfiler.End();
 
-#pragma region DeskLeg Binding / Generation
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, deskTextureId);
-    scale = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glBindVertexArray(gMesh.vao[6]);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[6]);
-#pragma endregion
-
-#pragma region MonitorStand Binding / Generation
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, monitorTextureId);
-    scale = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
-    rotation = glm::rotate(45.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-    translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-    model = translation * rotation * scale;
-    modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glBindVertexArray(gMesh.vao[7]);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[7]);
+    gProfiler.End();
 #pragma endregion
 
 #pragma region Light Binding / Generation
+    gProfiler.Begin("lamp");
+
     //Draw Lamp
-    glUseProgram(gLampProgramId);
+    gState.UseProgram(gLampProgram.Id);
     //transform the cube used as a visual cue for the light source
-    model = glm::translate(gLightPosition) * glm::scale(gLightScale);
-    //reference matrix uniforms from the Lamp Shader Program
-    modelLoc = glGetUniformLocation(gLampProgramId, "model");
-    viewLoc = glGetUniformLocation(gLampProgramId, "view");
-    projLoc = glGetUniformLocation(gLampProgramId, "projection");
-    //pass matrix data to the lamp shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(projection));
-    glBindVertexArray(gMesh.vao[8]);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices[8]);
+    glm::mat4 model = glm::translate(gLightPosition) * glm::scale(gLightScale);
+    //pass the model matrix to the lamp shader program, view and projection come from the frame uniform buffer
+    glUniformMatrix4fv(gLampProgram.Location("model"), 1, GL_FALSE, glm::value_ptr(model));
+    MeshHandle lampHandle = gMesh.handle[LAMP_MESH];
+    if (gMesh.pool.IsValid(lampHandle))
+        glDrawElementsBaseVertex(GL_TRIANGLES, gMesh.pool.Range(lampHandle).IndexCount, gMesh.pool.IndexType(), gMesh.pool.IndexOffset(lampHandle), gMesh.pool.Range(lampHandle).BaseVertex);
+
+    gProfiler.End();
 #pragma endregion
 
-    //Deactivate vertex array object
-    glBindVertexArray(0);
+    // The shared VAO stays bound for the next frame, the state cache drops the rebind
+
 
+    // queue the readback of this frame before the back buffer is swapped away, stop when frames can't be written
+    if (gCapturing)
+    {
+        ProfileScope captureScope(gProfiler, "capture");
+        if (!gCapture.Capture(gHeadless ? gRenderTarget.Framebuffer() : 0))
+            glfwSetWindowShouldClose(gWindow, GLFW_TRUE);
+    }
 
     //swap buffers and poll IO events
-    glfwSwapBuffers(gWindow);
+    if (!gHeadless)
+    {
+        ProfileScope swapScope(gProfiler, "swap");
+        glfwSwapBuffers(gWindow);
+    }
     
 
 
@@ -664,13 +1000,232 @@ void URender()
 }
 
 
+// Uploads the textures that finished decoding since the last call and hands them to their materials
+void UUpdateTextures()
+{
+    ProfileScope scope(gProfiler, "textures");
+    gTextureLoader.Update(gState);
+    for (size_t i = 0; i < gTextureLoader.UploadedTextures().size(); ++i)
+        gMaterials.Refresh(gTextureLoader.UploadedTextures()[i], gState);
+    gTextureCache.Update(gState);
+}
+
+
+// Renders gFrameCount frames offscreen, flying the camera along gCameraPath, and captures each one
+bool URenderFrames()
+{
+    if (!gRenderTarget.Create(WINDOW_WIDTH, WINDOW_HEIGHT))
+        return false;
+    gCapture.Start(gRenderTarget.Width(), gRenderTarget.Height(), gCaptureFormat, gOutputDirectory);
+    UWaitForTextures();
+
+    // URender flags the window to close when a frame couldn't be written
+    for (int frame = 0; frame < gFrameCount && !glfwWindowShouldClose(gWindow); ++frame)
+    {
+        gProfiler.BeginFrame();
+        if (!gCameraPath.Empty())
+            UApplyCameraKey(gCameraPath.Sample(gFrameCount > 1 ? (float)frame / (gFrameCount - 1) : 0.0f));
+        URender();
+        gProfiler.EndFrame();
+    }
+    bool success = UFinishCapture();
+
+    gRenderTarget.Destroy();
+    return success;
+}
+
+
+// Waits until every texture is final, otherwise early frames would show placeholders
+void UWaitForTextures()
+{
+    while (gTextureLoader.Pending() > 0)
+    {
+        UUpdateTextures();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    UUpdateTextures();
+}
+
+
+// Renders gWarmupFrames and then gFrameCount measured frames with the camera driven along gCameraPath through the
+// same Camera input calls as the keyboard and mouse. Measured frames are BENCHMARK_TIMESTEP of flight time apart
+// and the path takes BENCHMARK_PATH_DURATION, so every run renders the same frames whatever --frames is, and only
+// the time they take differs. Vsync is off when rendering to a window
+bool URunBenchmark()
+{
+    if (gHeadless && !gRenderTarget.Create(WINDOW_WIDTH, WINDOW_HEIGHT))
+        return false;
+    int width = WINDOW_WIDTH, height = WINDOW_HEIGHT;
+    if (!gHeadless)
+    {
+        glfwSwapInterval(0);
+        glfwGetFramebufferSize(gWindow, &width, &height);
+    }
+    if (gCapturing)
+        gCapture.Start(width, height, gCaptureFormat, gOutputDirectory);
+    UWaitForTextures();
+
+    // the flight starts from the first key, the warmup frames stay there
+    UApplyCameraKey(gCameraPath.Sample(0.0f));
+
+    MeshHandle lampHandle = gMesh.handle[LAMP_MESH];
+    size_t lampTriangles = gMesh.pool.IsValid(lampHandle) ? gMesh.pool.Range(lampHandle).IndexCount / 3 : 0;
+    double drawCalls = 0.0, triangles = 0.0, objects = 0.0;
+    int totalFrames = gWarmupFrames + gFrameCount;
+    for (int frame = 0; frame < totalFrames && !glfwWindowShouldClose(gWindow); ++frame)
+    {
+        int measured = frame - gWarmupFrames;
+        if (measured == 0)
+            gState.ResetCounters();
+
+        gProfiler.BeginFrame();
+        if (measured > 0)
+        {
+            float flight = fmodf(measured * BENCHMARK_TIMESTEP, BENCHMARK_PATH_DURATION);
+            UReplayCameraKey(gCameraPath.Sample(flight / BENCHMARK_PATH_DURATION, gSplinePath));
+        }
+        URender();
+        gProfiler.EndFrame();
+        if (!gHeadless)
+            glfwPollEvents();
+
+        if (measured >= 0)
+        {
+            drawCalls += gBatch.MultiDrawCalls() + gBatch.InstancedCalls() + (lampTriangles ? 1 : 0);
+            triangles += gBatch.TriangleCount() + lampTriangles;
+            objects += gBatch.DrawCount();
+        }
+    }
+
+    bool success = !glfwWindowShouldClose(gWindow);
+    if (gCapturing)
+        success = UFinishCapture() && success;
+    gProfiler.Flush();
+    if (success)
+        success = UWriteBenchmarkResults(width, height, drawCalls / gFrameCount, triangles / gFrameCount, objects / gFrameCount);
+    if (gHeadless)
+        gRenderTarget.Destroy();
+    return success;
+}
+
+
+// Turns and moves the camera onto a key as mouse and keyboard input would: the turn is fed through
+// ProcessMouseMovement, then the move is split along the camera's front, right and up vectors and fed through
+// ProcessKeyboard for one BENCHMARK_TIMESTEP, at the speed that covers each part of the move in that time
+void UReplayCameraKey(const CameraKey &key)
+{
+    gCamera.ProcessMouseMovement((key.Yaw - gCamera.Yaw) / gCamera.MouseSensitivity, (key.Pitch - gCamera.Pitch) / gCamera.MouseSensitivity);
+
+    glm::vec3 offset = key.Position - gCamera.Position;
+    float forward = glm::dot(offset, gCamera.Front);
+    float right = glm::dot(offset, gCamera.Right);
+    float up = glm::dot(offset, gCamera.Up);
+    float speed = gCamera.MovementSpeed;
+    gCamera.MovementSpeed = fabsf(forward) / BENCHMARK_TIMESTEP;
+    gCamera.ProcessKeyboard(forward >= 0.0f ? FORWARD : BACKWARD, BENCHMARK_TIMESTEP);
+    gCamera.MovementSpeed = fabsf(right) / BENCHMARK_TIMESTEP;
+    gCamera.ProcessKeyboard(right >= 0.0f ? RIGHT : LEFT, BENCHMARK_TIMESTEP);
+    gCamera.MovementSpeed = fabsf(up) / BENCHMARK_TIMESTEP;
+    gCamera.ProcessKeyboard(up >= 0.0f ? UP : DOWN, BENCHMARK_TIMESTEP);
+    gCamera.MovementSpeed = speed;
+}
+
+
+// Writes the measurements of a benchmark as JSON: frame time percentiles and every frame time in milliseconds,
+// and the per frame averages of draw calls, triangles, objects and GL state changes
+bool UWriteBenchmarkResults(int width, int height, double drawCalls, double triangles, double objects)
+{
+    std::vector<double> cpuTimes, gpuTimes;
+    gProfiler.FrameTimes(cpuTimes, gpuTimes);
+
+    FILE* file = fopen(gBenchmarkResults.c_str(), "w");
+    if (!file)
+    {
+        cout << "ERROR::BENCHMARK::WRITE_FAILED " << gBenchmarkResults << endl;
+        return false;
+    }
+    const GLubyte* renderer = glGetString(GL_RENDERER);
+    const GLubyte* version = glGetString(GL_VERSION);
+    fprintf(file, "{\n");
+    fprintf(file, "  \"renderer\": \"%s\",\n  \"version\": \"%s\",\n", renderer ? (const char*)renderer : "", version ? (const char*)version : "");
+    fprintf(file, "  \"headless\": %s,\n  \"width\": %d,\n  \"height\": %d,\n", gHeadless ? "true" : "false", width, height);
+    fprintf(file, "  \"warmup_frames\": %d,\n  \"frames\": %u,\n  \"timestep\": %.6f,\n  \"path_duration\": %.3f,\n", gWarmupFrames,
+        (unsigned)cpuTimes.size(), BENCHMARK_TIMESTEP, BENCHMARK_PATH_DURATION);
+
+    const char* names[2] = { "cpu_frame_ms", "gpu_frame_ms" };
+    std::vector<double>* times[2] = { &cpuTimes, &gpuTimes };
+    for (int i = 0; i < 2; ++i)
+    {
+        std::vector<double> sorted = *times[i];
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (size_t f = 0; f < sorted.size(); ++f)
+            total += sorted[f];
+        fprintf(file, "  \"%s\": {", names[i]);
+        if (!sorted.empty())
+            fprintf(file, "\"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f, ",
+                total / sorted.size() / 1000.0, sorted.front() / 1000.0, FrameProfiler::Percentile(sorted, 0.50) / 1000.0,
+                FrameProfiler::Percentile(sorted, 0.95) / 1000.0, FrameProfiler::Percentile(sorted, 0.99) / 1000.0, sorted.back() / 1000.0);
+        fprintf(file, "\"frames\": [");
+        for (size_t f = 0; f < times[i]->size(); ++f)
+            fprintf(file, "%s%.4f", f ? ", " : "", (*times[i])[f] / 1000.0);
+        fprintf(file, "]},\n");
+    }
+
+    double frames = (double)gFrameCount;
+    fprintf(file, "  \"draw_calls\": %.2f,\n  \"triangles\": %.2f,\n  \"objects\": %.2f,\n", drawCalls, triangles, objects);
+    fprintf(file, "  \"state_changes\": {\"issued\": %.2f, \"dropped\": %.2f}\n", gState.Issued() / frames, gState.Dropped() / frames);
+    fprintf(file, "}\n");
+    bool written = !ferror(file);
+    written = fclose(file) == 0 && written;
+    if (!written)
+    {
+        cout << "ERROR::BENCHMARK::WRITE_FAILED " << gBenchmarkResults << endl;
+        return false;
+    }
+    cout << "INFO: benchmark of " << cpuTimes.size() << " frames written to " << gBenchmarkResults << endl;
+    return true;
+}
+
+
+// Waits for the frames still being read back or encoded and reports how often rendering waited on capture
+bool UFinishCapture()
+{
+    bool success = gCapture.Finish();
+    if (success)
+        cout << "INFO: captured " << gCapture.Frames() << " frames, rendering waited on capture " << gCapture.Waits() << " times" << endl;
+    return success;
+}
+
+
+// Prints the summary of the last frames and writes their trace
+bool UFinishProfile()
+{
+    gProfiler.Flush();
+    gProfiler.Summary(cout);
+    bool written = gProfiler.WriteChromeTrace(gProfileTrace);
+    if (written)
+        cout << "INFO: wrote the trace of " << gProfiler.Frames() << " frames to " << gProfileTrace << endl;
+    gProfiler.Destroy();
+    return written;
+}
+
+
+// Moves the camera to a key of a camera path, keeping its zoom
+void UApplyCameraKey(const CameraKey &key)
+{
+    float zoom = gCamera.Zoom;
+    gCamera = Camera(key.Position, glm::vec3(0.0f, 1.0f, 0.0f), key.Yaw, key.Pitch);
+    gCamera.Zoom = zoom;
+}
+
+
 // Implements the UCreateMesh function
 void UCreateMesh(GLMesh &mesh)
 {
     const GLuint floatsPerVertex = 3;
     const GLuint floatsPerNormal = 3;
     const GLuint floatsPerUV = 2;
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
 
     //vertex Data
     GLfloat filingCabinetVerts[] = {
@@ -1050,195 +1605,75 @@ void UCreateMesh(GLMesh &mesh)
          0.01f, 0.60f, -0.01f,  0.0f, -1.0f,  0.0f,  0.0f,  0.0f,
 
     };
-    mesh.nVertices[0] = sizeof(filingCabinetVerts) / (sizeof(filingCabinetVerts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    mesh.nVertices[1] = sizeof(desktopVerts) / (sizeof(desktopVerts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    mesh.nVertices[2] = sizeof(pcVerts) / (sizeof(pcVerts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    mesh.nVertices[3] = sizeof(keyboardVerts) / (sizeof(keyboardVerts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    mesh.nVertices[4] = sizeof(monitorVerts) / (sizeof(monitorVerts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    mesh.nVertices[5] = sizeof(speakerVerts) / (sizeof(speakerVerts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    mesh.nVertices[6] = sizeof(desklegVerts) / (sizeof(desklegVerts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    mesh.nVertices[7] = sizeof(monitorstandVerts) / (sizeof(monitorstandVerts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-
-#pragma region Filing Cabinet Mesh
-    glGenVertexArrays(1, &mesh.vao[0]);
-    glGenBuffers(1, &mesh.vbo[0]);
-    glBindVertexArray(mesh.vao[0]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(filingCabinetVerts), filingCabinetVerts, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-#pragma endregion
-
-#pragma region Desk Top Mesh
-    glGenVertexArrays(1, &mesh.vao[1]);
-    glGenBuffers(1, &mesh.vbo[1]);
-    glBindVertexArray(mesh.vao[1]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(desktopVerts), desktopVerts, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-#pragma endregion
-
-#pragma region PC Mesh
-    glGenVertexArrays(1, &mesh.vao[2]);
-    glGenBuffers(1, &mesh.vbo[2]);
-    glBindVertexArray(mesh.vao[2]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[2]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(pcVerts), pcVerts, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-#pragma endregion
-
-#pragma region Keyboard Mesh
-    glGenVertexArrays(1, &mesh.vao[3]);
-    glGenBuffers(1, &mesh.vbo[3]);
-    glBindVertexArray(mesh.vao[3]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[3]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(keyboardVerts), keyboardVerts, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-#pragma endregion
-
-#pragma region Monitor Mesh
-    glGenVertexArrays(1, &mesh.vao[4]);
-    glGenBuffers(1, &mesh.vbo[4]);
-    glBindVertexArray(mesh.vao[4]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[4]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(monitorVerts), monitorVerts, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-#pragma endregion
-
-#pragma region Speaker Mesh
-    glGenVertexArrays(1, &mesh.vao[5]);
-    glGenBuffers(1, &mesh.vbo[5]);
-    glBindVertexArray(mesh.vao[5]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[5]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(speakerVerts), speakerVerts, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-#pragma endregion
-
-#pragma region Desk Leg Mesh
-    glGenVertexArrays(1, &mesh.vao[6]);
-    glGenBuffers(1, &mesh.vbo[6]);
-    glBindVertexArray(mesh.vao[6]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[6]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(desklegVerts), desklegVerts, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-#pragma endregion
+    const GLuint floatsPerVertexTotal = floatsPerVertex + floatsPerNormal + floatsPerUV;
+
+    // Every mesh is sub-allocated from one arena; the initial capacity fits the office and grows if needed
+    mesh.pool.Create(1024, 2048);
+    for (int i = 0; i < 9; ++i)
+        mesh.handle[i] = MeshPool::InvalidHandle;
+
+    // Weld the duplicated corners of every box and build cache-friendly index buffers
+    MeshBuilder builder(floatsPerVertexTotal);
+    mesh.handle[FILING_CABINET_MESH] = mesh.pool.Upload(builder.Build(filingCabinetVerts, sizeof(filingCabinetVerts) / (sizeof(filingCabinetVerts[0]) * floatsPerVertexTotal)));
+    mesh.handle[DESKTOP_MESH] = mesh.pool.Upload(builder.Build(desktopVerts, sizeof(desktopVerts) / (sizeof(desktopVerts[0]) * floatsPerVertexTotal)));
+    mesh.handle[PC_MESH] = mesh.pool.Upload(builder.Build(pcVerts, sizeof(pcVerts) / (sizeof(pcVerts[0]) * floatsPerVertexTotal)));
+    mesh.handle[KEYBOARD_MESH] = mesh.pool.Upload(builder.Build(keyboardVerts, sizeof(keyboardVerts) / (sizeof(keyboardVerts[0]) * floatsPerVertexTotal)));
+    mesh.handle[MONITOR_MESH] = mesh.pool.Upload(builder.Build(monitorVerts, sizeof(monitorVerts) / (sizeof(monitorVerts[0]) * floatsPerVertexTotal)));
+    mesh.handle[SPEAKER_MESH] = mesh.pool.Upload(builder.Build(speakerVerts, sizeof(speakerVerts) / (sizeof(speakerVerts[0]) * floatsPerVertexTotal)));
+    mesh.handle[DESK_LEG_MESH] = mesh.pool.Upload(builder.Build(desklegVerts, sizeof(desklegVerts) / (sizeof(desklegVerts[0]) * floatsPerVertexTotal)));
+    mesh.handle[MONITOR_STAND_MESH] = mesh.pool.Upload(builder.Build(monitorstandVerts, sizeof(monitorstandVerts) / (sizeof(monitorstandVerts[0]) * floatsPerVertexTotal)));
 
-#pragma region Monitor Stand Mesh
-    glGenVertexArrays(1, &mesh.vao[7]);
-    glGenBuffers(1, &mesh.vbo[7]);
-    glBindVertexArray(mesh.vao[7]);
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[7]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(monitorstandVerts), monitorstandVerts, GL_STATIC_DRAW);
 
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-#pragma endregion
+// Places every object of the office in the scene
+void UCreateScene(Scene &scene)
+{
+    GLuint filingCabinetMaterial = scene.AddMaterial(filingCabinetTextureId, gTexWrapMode);
+    GLuint deskMaterial = scene.AddMaterial(deskTextureId, gTexWrapMode);
+    GLuint pcMaterial = scene.AddMaterial(pcTextureId, gTexWrapMode);
+    GLuint keyboardMaterial = scene.AddMaterial(keyboardTextureId, gTexWrapMode);
+    GLuint monitorMaterial = scene.AddMaterial(monitorTextureId, gTexWrapMode);
+    GLuint speakerMaterial = scene.AddMaterial(speakerTextureId, gTexWrapMode);
+
+    // The bounds computed when the meshes were built are used to cull the nodes drawing them
+    for (GLuint id = 0; id < sizeof(gMesh.handle) / sizeof(gMesh.handle[0]); ++id)
+        if (gMesh.pool.IsValid(gMesh.handle[id]))
+            scene.SetMeshBounds(id, gMesh.pool.Range(gMesh.handle[id]).Bounds);
+
+    const glm::vec3 yAxis(0.0f, 1.0f, 0.0f);
+    scene.AddNode(FILING_CABINET_MESH, filingCabinetMaterial, glm::vec3(0.75f, 0.0f, -0.25f), 45.0f, yAxis, glm::vec3(1.0f, 1.0f, 0.5f));
+    scene.AddNode(DESKTOP_MESH, deskMaterial, glm::vec3(0.0f, 0.0f, 0.0f), 45.0f, yAxis, glm::vec3(1.0f, 1.0f, 1.0f));
+    scene.AddNode(PC_MESH, pcMaterial, glm::vec3(0.8f, 0.0f, 0.0f), 45.0f, yAxis, glm::vec3(1.0f, 1.0f, 0.25f));
+    scene.AddNode(KEYBOARD_MESH, keyboardMaterial, glm::vec3(0.0f, 0.0f, 0.0f), 45.0f, yAxis, glm::vec3(1.25f, 1.0f, 1.0f));
+    scene.AddNode(MONITOR_MESH, monitorMaterial, glm::vec3(0.0f, 0.0f, 0.0f), 45.0f, yAxis, glm::vec3(1.0f, 1.0f, 1.0f));
+    scene.AddNode(SPEAKER_MESH, speakerMaterial, glm::vec3(-0.75f, 0.0f, 0.40f), 45.0f, yAxis, glm::vec3(1.0f, 1.0f, 1.0f));
+    scene.AddNode(DESK_LEG_MESH, deskMaterial, glm::vec3(0.0f, 0.0f, 0.0f), 45.0f, yAxis, glm::vec3(1.0f, 1.0f, 1.0f));
+    scene.AddNode(MONITOR_STAND_MESH, monitorMaterial, glm::vec3(0.0f, 0.0f, 0.0f), 45.0f, yAxis, glm::vec3(1.0f, 1.0f, 1.0f));
 }
 
 void UDestroyMesh(GLMesh& mesh)
 {
-    glDeleteVertexArrays(10, mesh.vao);
-    glDeleteBuffers(10, mesh.vbo);
+    mesh.pool.Destroy();
 }
 
-/*Generate and load the texture*/
+/*Generate and load the texture through the texture cache. A baked .dds next to the image is uploaded as is,
+  otherwise the image is queued for loading and the texture holds a placeholder until then*/
 bool UCreateTexture(const char* filename, GLuint& textureId)
 {
-    int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-    if (image)
-    {
-        flipImageVertically(image, width, height, channels);
-
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
-
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        else
-        {
-            cout << "Not implemented to handle image with " << channels << " channels" << endl;
-            return false;
-        }
-
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
-
-        return true;
-    }
-
-    // Error loading the image
-    return false;
+    textureId = gTextureCache.Acquire(filename, gState);
+    return textureId != 0;
 }
 
 
+/*Release a texture. Cached textures are deleted when evicted or when the cache is cleared*/
 void UDestroyTexture(GLuint textureId)
 {
-    glGenTextures(1, &textureId);
+    if (gTextureCache.Release(textureId))
+        return;
+
+    gState.ForgetTexture(textureId);
+    glDeleteTextures(1, &textureId);
 }
 
 
@@ -1249,8 +1684,15 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
     int success = 0;
     char infoLog[512];
 
+    // Reuse the binary of an earlier run when there is one
+    programId = gProgramCache.Load(vtxShaderSource, fragShaderSource);
+    if (programId)
+        return true;
+
     // Create a Shader program object.
     programId = glCreateProgram();
+    // Keep the linked binary retrievable for the program cache
+    glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
     // Create the vertex and fragment shader objects
     GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
@@ -1269,6 +1711,7 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
         glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
         std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
 
+        UDeleteFailedProgram(programId, vertexShaderId, fragmentShaderId);
         return false;
     }
 
@@ -1280,6 +1723,7 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
         glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
         std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
 
+        UDeleteFailedProgram(programId, vertexShaderId, fragmentShaderId);
         return false;
     }
 
@@ -1295,15 +1739,109 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
         glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
         std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
 
+        UDeleteFailedProgram(programId, vertexShaderId, fragmentShaderId);
         return false;
     }
 
-    glUseProgram(programId);    // Uses the shader program
+    // The shaders are no longer needed once linked, and the next run can skip compiling altogether
+    glDeleteShader(vertexShaderId);
+    glDeleteShader(fragmentShaderId);
+    gProgramCache.Store(programId, vtxShaderSource, fragShaderSource);
 
+    // The program isn't made current here: builds happen mid-frame and on the reloader's context, callers bind
+    // programs through the state cache
     return true;
 }
 
 
+// Releases what a failed build created, the shader reloader retries on every edit and must not leak
+void UDeleteFailedProgram(GLuint &programId, GLuint vertexShaderId, GLuint fragmentShaderId)
+{
+    glDeleteShader(vertexShaderId);
+    glDeleteShader(fragmentShaderId);
+    glDeleteProgram(programId);
+    programId = 0;
+}
+
+
+// Creates a shader program and reflects its uniforms. Also builds the programs of the shader reloader on its own
+// context, so it must not touch anything but GL objects and the program cache
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, ShaderProgram &program)
+{
+    GLuint programId = 0;
+    if (!UCreateShaderProgram(vtxShaderSource, fragShaderSource, programId))
+        return false;
+
+    program.Reflect(programId);
+    return true;
+}
+
+
+// Sets the uniforms of a main pass variant that never change, without binding it
+void USetupVariantProgram(ShaderProgram &program)
+{
+    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
+    // We set the texture array as texture unit 0 (unused with bindless textures and untextured variants)
+    if (program.Has("uMaterialTextures"))
+        glProgramUniform1i(program.Id, program.Location("uMaterialTextures"), 0);
+    // The UV scale never changes, so it is set once as well
+    if (program.Has("uvScale"))
+        glProgramUniform2fv(program.Id, program.Location("uvScale"), 1, glm::value_ptr(gUVScale));
+}
+
+
+// Reads and joins shader files, in order
+bool UReadShaderFiles(const std::vector<std::string> &filenames, std::string &source)
+{
+    source.clear();
+    for (size_t i = 0; i < filenames.size(); ++i)
+    {
+        std::string contents;
+        if (!ShaderReloader::ReadFile(filenames[i], contents))
+        {
+            cout << "Failed to load shader " << filenames[i] << endl;
+            return false;
+        }
+        source += contents;
+    }
+    return true;
+}
+
+
+// Replaces programs with the ones rebuilt by the shader reloader. Only builds that succeeded arrive here, so a
+// broken edit leaves the running programs in place
+void USwapReloadedShaders()
+{
+    ProfileScope scope(gProfiler, "shader reload");
+    std::vector<ShaderReloader::Reload> reloads = gShaderReloader.Poll();
+    for (size_t i = 0; i < reloads.size(); ++i)
+    {
+        const ShaderReloader::Reload &reload = reloads[i];
+        if (reload.Key == gMainPassShaders)
+        {
+            gVariants.SetSources(reload.VertexSource, reload.FragmentSource);
+            for (size_t v = 0; v < reload.Masks.size(); ++v)
+                gVariants.Replace(reload.Masks[v], reload.Programs[v]);
+        }
+        else if (reload.Key == gLampShaders)
+        {
+            glDeleteProgram(gLampProgram.Id);
+            gLampProgram.Reflect(reload.Programs[0]);
+        }
+    }
+    // programs were switched behind the state cache's back
+    if (!reloads.empty())
+        gState.Invalidate();
+}
+
+
+// Picks the cheapest variant that can draw a material through the batch renderer
+uint32_t UMaterialFeatures(const Material &material)
+{
+    return ShaderFeatureMask(material.TextureId != 0, material.SpecularIntensity > 0.0f, gLightCount);
+}
+
+
 void UDestroyShaderProgram(GLuint programId)
 {
     glDeleteProgram(programId);
@@ -0,0 +1,368 @@
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "glstate.h"
+#include "glsync.h"
+#include "meshpool.h"
+
+// Layout of one glMultiDrawElementsIndirect command
+struct DrawElementsIndirectCommand
+{
+    GLuint Count;
+    GLuint InstanceCount;
+    GLuint FirstIndex;
+    GLint  BaseVertex;
+    GLuint BaseInstance;
+};
+
+// Per-object data read by the vertex shader, matches the std430 ObjectData struct
+struct ObjectData
+{
+    glm::mat4 Model;
+    glm::vec4 NormalMatrix[3];  // mat3 columns, padded to vec4 as std430 lays them out
+    GLuint    Material;
+    GLuint    Padding[3];
+};
+
+// Draws recorded by one thread for BatchRenderer::Submit. BaseInstance of every command indexes the objects
+// returned by BatchRenderer::MapObjects
+struct CommandList
+{
+    std::vector<DrawElementsIndirectCommand> Commands;
+    std::vector<GLuint> Materials;
+    std::vector<GLuint> Programs;
+
+    void Clear()
+    {
+        Commands.clear();
+        Materials.clear();
+        Programs.clear();
+    }
+};
+
+// Collects the draws of a pass and submits them with glMultiDrawElementsIndirect. Per-object data goes into an
+// SSBO, written in place through a persistently mapped ring; each command's baseInstance is the index of its first
+// object, which reaches the shader through a per-instance attribute (location 3) reading an identity buffer
+// 0, 1, 2, ... so instance i of a command reads object baseInstance + i. This works on plain GL 4.4 where
+// gl_DrawID and gl_BaseInstance would need ARB_shader_draw_parameters.
+// Consecutive draws of the same mesh with the same material are merged into one instanced command, so repeated
+// furniture costs one command no matter how many copies there are. Draws name the program drawing them; each
+// run of consecutive commands sharing a program becomes one multi-draw.
+// A pass may be recorded on several threads: MapObjects hands out the object array of the pass, each thread
+// records its part of the draws with Record into its own CommandList, and Submit replays the lists in order on
+// the GL thread
+class BatchRenderer
+{
+public:
+    // SSBO binding point of the ObjectData array
+    static const GLuint ObjectBinding = 0;
+    // attribute location and vertex buffer binding point of the object index
+    static const GLuint DrawIdLocation = 3;
+    static const GLuint DrawIdBinding = 1;
+
+    // frames whose mapped objects may still be read by the GPU
+    static const int MappedRegions = 3;
+
+    BatchRenderer() : mVao(0), mCapacity(0), mCommandBuffer(0), mDrawIdBuffer(0), mMultiDrawCalls(0), mInstancedCalls(0),
+        mMappedBuffer(0), mMappedObjects(NULL), mMappedCapacity(0), mRegionStride(0), mRegion(0), mListObjects(0)
+    {
+        for (int i = 0; i < MappedRegions; ++i)
+            mRegionFences[i] = 0;
+    }
+
+    // creates the buffers and adds the object index attribute to the VAO of the mesh pool
+    void Create(const MeshPool &pool, GLuint capacity)
+    {
+        mVao = pool.Vao();
+        glGenBuffers(1, &mCommandBuffer);
+        glGenBuffers(1, &mDrawIdBuffer);
+
+        glBindVertexArray(mVao);
+        glVertexAttribIFormat(DrawIdLocation, 1, GL_UNSIGNED_INT, 0);
+        glVertexAttribBinding(DrawIdLocation, DrawIdBinding);
+        glVertexBindingDivisor(DrawIdBinding, 1);
+        glEnableVertexAttribArray(DrawIdLocation);
+        glBindVertexArray(0);
+
+        reserve(capacity);
+    }
+
+    void Destroy()
+    {
+        releaseMapped();
+        glDeleteBuffers(1, &mCommandBuffer);
+        glDeleteBuffers(1, &mDrawIdBuffer);
+        mCommandBuffer = mDrawIdBuffer = 0;
+        mCapacity = 0;
+    }
+
+    // starts recording a new pass
+    void Begin()
+    {
+        mCommands.clear();
+        mCommandMaterials.clear();
+        mCommandPrograms.clear();
+        mListObjects = 0;
+    }
+
+    // returns room for the count objects of a pass recorded with Record, in a region of a persistently mapped ring
+    // that the GPU has finished reading. Must be called on the GL thread before recording
+    ObjectData* MapObjects(GLuint count, GLStateCache &state)
+    {
+        if (count > mCapacity)
+        {
+            reserve(count * 2);
+            state.Invalidate();
+        }
+        if (count > mMappedCapacity || !mMappedObjects)
+            reserveMapped(count * 2);
+
+        mRegion = (mRegion + 1) % MappedRegions;
+        if (mRegionFences[mRegion])
+        {
+            WaitForFence(mRegionFences[mRegion]);
+            glDeleteSync(mRegionFences[mRegion]);
+            mRegionFences[mRegion] = 0;
+        }
+        mListObjects = count;
+        return (ObjectData*)((char*)mMappedObjects + mRegion * mRegionStride);
+    }
+
+    // records the draw of object objectIndex into list and writes the object. Only touches list and
+    // objects[objectIndex], so threads may record disjoint objects into their own lists at the same time.
+    // Consecutive draws of the same mesh, material and program become instances of one command. program 0 draws
+    // with whatever program is current
+    static void Record(CommandList &list, const MeshPool &pool, MeshHandle mesh, const glm::mat4 &model, const glm::mat3 &normalMatrix,
+        GLuint material, GLuint program, GLuint objectIndex, ObjectData* objects)
+    {
+        writeObject(objects[objectIndex], model, normalMatrix, material);
+
+        const MeshRange &range = pool.Range(mesh);
+        if (!list.Commands.empty())
+        {
+            DrawElementsIndirectCommand &last = list.Commands.back();
+            if (last.FirstIndex == range.FirstIndex && last.BaseVertex == range.BaseVertex && last.Count == range.IndexCount &&
+                list.Materials.back() == material && list.Programs.back() == program && last.BaseInstance + last.InstanceCount == objectIndex)
+            {
+                ++last.InstanceCount;
+                return;
+            }
+        }
+
+        DrawElementsIndirectCommand command;
+        command.Count = range.IndexCount;
+        command.InstanceCount = 1;
+        command.FirstIndex = range.FirstIndex;
+        command.BaseVertex = range.BaseVertex;
+        command.BaseInstance = objectIndex;
+        list.Commands.push_back(command);
+        list.Materials.push_back(material);
+        list.Programs.push_back(program);
+    }
+
+    // draws lists recorded against the last MapObjects, in order. Each run of commands sharing a program is drawn
+    // with one glMultiDrawElementsIndirect call, or a plain instanced draw when the run is a single command.
+    // Materials are looked up by the shaders, so only the program changes between draws: record the draws sorted by
+    // program, material and mesh to get one multi-draw per program and one command per mesh. A command continuing
+    // the last one of the previous list is merged into it, so splitting a pass across threads costs no extra commands
+    void Submit(const CommandList* lists, size_t listCount, GLStateCache &state, GLenum indexType)
+    {
+        mCommands.clear();
+        mCommandMaterials.clear();
+        mCommandPrograms.clear();
+        for (size_t l = 0; l < listCount; ++l)
+        {
+            const CommandList &list = lists[l];
+            for (size_t i = 0; i < list.Commands.size(); ++i)
+            {
+                const DrawElementsIndirectCommand &command = list.Commands[i];
+                if (i == 0 && !mCommands.empty())
+                {
+                    DrawElementsIndirectCommand &last = mCommands.back();
+                    if (last.FirstIndex == command.FirstIndex && last.BaseVertex == command.BaseVertex && last.Count == command.Count &&
+                        mCommandMaterials.back() == list.Materials[i] && mCommandPrograms.back() == list.Programs[i] &&
+                        last.BaseInstance + last.InstanceCount == command.BaseInstance)
+                    {
+                        last.InstanceCount += command.InstanceCount;
+                        continue;
+                    }
+                }
+                mCommands.push_back(command);
+                mCommandMaterials.push_back(list.Materials[i]);
+                mCommandPrograms.push_back(list.Programs[i]);
+            }
+        }
+
+        mMultiDrawCalls = 0;
+        mInstancedCalls = 0;
+        if (mCommands.empty())
+            return;
+
+        // the objects are already in place, only the commands are uploaded
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, mCommands.size() * sizeof(DrawElementsIndirectCommand), mCommands.data(), GL_STREAM_DRAW);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, ObjectBinding, mMappedBuffer, mRegion * mRegionStride, mListObjects * sizeof(ObjectData));
+
+        draw(state, indexType);
+        mRegionFences[mRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // number of objects recorded for the current pass
+    size_t DrawCount() const
+    {
+        return mListObjects;
+    }
+
+    // number of indirect commands recorded for the current pass, less than DrawCount when draws were instanced
+    size_t CommandCount() const
+    {
+        return mCommands.size();
+    }
+
+    // number of triangles drawn by the recorded pass, counting every instance
+    size_t TriangleCount() const
+    {
+        size_t triangles = 0;
+        for (size_t i = 0; i < mCommands.size(); ++i)
+            triangles += (size_t)mCommands[i].Count / 3 * mCommands[i].InstanceCount;
+        return triangles;
+    }
+
+    // number of glMultiDrawElementsIndirect calls issued by the last Submit
+    unsigned MultiDrawCalls() const
+    {
+        return mMultiDrawCalls;
+    }
+
+    // number of direct instanced draw calls issued by the last Submit
+    unsigned InstancedCalls() const
+    {
+        return mInstancedCalls;
+    }
+
+private:
+    GLuint mVao;
+    GLuint mCapacity;
+    GLuint mCommandBuffer;
+    GLuint mDrawIdBuffer;
+    unsigned mMultiDrawCalls;
+    unsigned mInstancedCalls;
+    std::vector<DrawElementsIndirectCommand> mCommands;
+    std::vector<GLuint> mCommandMaterials;
+    std::vector<GLuint> mCommandPrograms;
+
+    // persistently mapped ring of object arrays for recorded command lists, one region per frame in flight
+    GLuint mMappedBuffer;
+    void* mMappedObjects;
+    GLuint mMappedCapacity;
+    GLintptr mRegionStride;
+    int mRegion;
+    GLsync mRegionFences[MappedRegions];
+    GLuint mListObjects;    // objects of the current pass
+
+    // issues the commands with the indirect buffer bound, one draw call per run of commands sharing a program
+    void draw(GLStateCache &state, GLenum indexType)
+    {
+        state.BindVertexArray(mVao);
+        GLsizeiptr indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        for (size_t first = 0; first < mCommands.size(); )
+        {
+            size_t end = first + 1;
+            while (end < mCommands.size() && mCommandPrograms[end] == mCommandPrograms[first])
+                ++end;
+            if (mCommandPrograms[first])
+                state.UseProgram(mCommandPrograms[first]);
+
+            if (end - first == 1)
+            {
+                // a single (possibly instanced) command doesn't need the indirect fetch
+                const DrawElementsIndirectCommand &command = mCommands[first];
+                glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.Count, indexType, (const void*)(command.FirstIndex * indexSize),
+                    command.InstanceCount, command.BaseVertex, command.BaseInstance);
+                ++mInstancedCalls;
+            }
+            else
+            {
+                glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (const void*)(first * sizeof(DrawElementsIndirectCommand)), (GLsizei)(end - first), 0);
+                ++mMultiDrawCalls;
+            }
+            first = end;
+        }
+    }
+
+    static void writeObject(ObjectData &object, const glm::mat4 &model, const glm::mat3 &normalMatrix, GLuint material)
+    {
+        object.Model = model;
+        for (int i = 0; i < 3; ++i)
+            object.NormalMatrix[i] = glm::vec4(normalMatrix[i], 0.0f);
+        object.Material = material;
+        object.Padding[0] = object.Padding[1] = object.Padding[2] = 0;
+    }
+
+    // sizes the GPU buffers for capacity objects and refills the identity buffer feeding the object index attribute
+    void reserve(GLuint capacity)
+    {
+        if (capacity == 0)
+            capacity = 1;
+        mCapacity = capacity;
+
+        std::vector<GLuint> drawIds(capacity);
+        for (GLuint i = 0; i < capacity; ++i)
+            drawIds[i] = i;
+        glBindBuffer(GL_ARRAY_BUFFER, mDrawIdBuffer);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GLuint), drawIds.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindVertexArray(mVao);
+        glBindVertexBuffer(DrawIdBinding, mDrawIdBuffer, 0, sizeof(GLuint));
+        glBindVertexArray(0);
+    }
+
+    // (re)creates the mapped ring with regions of capacity objects, each starting at a valid storage buffer offset
+    void reserveMapped(GLuint capacity)
+    {
+        releaseMapped();
+        if (capacity == 0)
+            capacity = 1;
+        mMappedCapacity = capacity;
+
+        GLint alignment = 1;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        mRegionStride = ((GLintptr)capacity * sizeof(ObjectData) + alignment - 1) / alignment * alignment;
+
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &mMappedBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mMappedBuffer);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, mRegionStride * MappedRegions, NULL, flags);
+        mMappedObjects = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, mRegionStride * MappedRegions, flags);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // the GL keeps a deleted buffer alive until the draws still reading it are done, so the fences can just go
+    void releaseMapped()
+    {
+        for (int i = 0; i < MappedRegions; ++i)
+        {
+            if (mRegionFences[i])
+                glDeleteSync(mRegionFences[i]);
+            mRegionFences[i] = 0;
+        }
+        if (mMappedBuffer)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, mMappedBuffer);
+            glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            glDeleteBuffers(1, &mMappedBuffer);
+        }
+        mMappedBuffer = 0;
+        mMappedObjects = NULL;
+        mMappedCapacity = 0;
+    }
+};
+#endif
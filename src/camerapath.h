@@ -0,0 +1,102 @@
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include <glm/glm.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// One camera pose of a path, with yaw and pitch in degrees as used by Camera
+struct CameraKey
+{
+    glm::vec3 Position;
+    float Yaw;
+    float Pitch;
+};
+
+// A scripted camera flight: keys spaced evenly over the path and interpolated linearly between. Files hold one
+// key per line as "x y z yaw pitch"; blank lines and lines starting with # are skipped
+class CameraPath
+{
+public:
+    std::vector<CameraKey> Keys;
+
+    bool Load(const std::string &filename)
+    {
+        std::ifstream file(filename.c_str());
+        if (!file)
+        {
+            std::cout << "ERROR::CAMERAPATH::FILE_NOT_FOUND " << filename << std::endl;
+            return false;
+        }
+
+        Keys.clear();
+        std::string line;
+        for (int number = 1; std::getline(file, line); ++number)
+        {
+            size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#')
+                continue;
+            std::istringstream stream(line);
+            CameraKey key;
+            if (!(stream >> key.Position.x >> key.Position.y >> key.Position.z >> key.Yaw >> key.Pitch))
+            {
+                std::cout << "ERROR::CAMERAPATH::BAD_KEY " << filename << ":" << number << std::endl;
+                return false;
+            }
+            Keys.push_back(key);
+        }
+        if (Keys.empty())
+            std::cout << "ERROR::CAMERAPATH::NO_KEYS " << filename << std::endl;
+        return !Keys.empty();
+    }
+
+    bool Empty() const
+    {
+        return Keys.empty();
+    }
+
+    // pose at t in [0, 1] along the path. With spline the keys are joined by a Catmull-Rom curve, which passes
+    // through every key without the corners of linear interpolation
+    CameraKey Sample(float t, bool spline = false) const
+    {
+        if (Keys.size() == 1 || t <= 0.0f)
+            return Keys.front();
+        if (t >= 1.0f)
+            return Keys.back();
+
+        float position = t * (float)(Keys.size() - 1);
+        size_t index = (size_t)position;
+        float blend = position - (float)index;
+        const CameraKey &a = Keys[index];
+        const CameraKey &b = Keys[index + 1];
+        CameraKey key;
+        if (!spline)
+        {
+            key.Position = a.Position + (b.Position - a.Position) * blend;
+            key.Yaw = a.Yaw + (b.Yaw - a.Yaw) * blend;
+            key.Pitch = a.Pitch + (b.Pitch - a.Pitch) * blend;
+            return key;
+        }
+
+        // the end keys are repeated to give the first and last segments their outer control points
+        const CameraKey &before = Keys[index > 0 ? index - 1 : index];
+        const CameraKey &after = Keys[index + 2 < Keys.size() ? index + 2 : index + 1];
+        key.Position = catmullRom(before.Position, a.Position, b.Position, after.Position, blend);
+        key.Yaw = catmullRom(before.Yaw, a.Yaw, b.Yaw, after.Yaw, blend);
+        key.Pitch = catmullRom(before.Pitch, a.Pitch, b.Pitch, after.Pitch, blend);
+        return key;
+    }
+
+private:
+    template <class T>
+    static T catmullRom(const T &p0, const T &p1, const T &p2, const T &p3, float t)
+    {
+        float t2 = t * t, t3 = t2 * t;
+        return ((p1 * 2.0f) + (p2 - p0) * t + (p0 * 2.0f - p1 * 5.0f + p2 * 4.0f - p3) * t2 + (p1 * 3.0f - p0 - p2 * 3.0f + p3) * t3) * 0.5f;
+    }
+};
+#endif
@@ -0,0 +1,102 @@
+#ifndef DDSFORMAT_H
+#define DDSFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// On-disk layout of the DDS files written by tools/texturebaker and read by ddstexture.h. Only block compressed
+// 2D textures with a full mip chain are produced: BC1 and BC3 through the legacy FourCC codes, BC7 through the
+// DX10 extension header. Rows are stored bottom row first so the data can be handed to OpenGL as is
+
+const uint32_t DDS_MAGIC = 0x20534444;   // "DDS "
+
+const uint32_t DDSD_CAPS = 0x1;
+const uint32_t DDSD_HEIGHT = 0x2;
+const uint32_t DDSD_WIDTH = 0x4;
+const uint32_t DDSD_PIXELFORMAT = 0x1000;
+const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+const uint32_t DDSD_LINEARSIZE = 0x80000;
+
+const uint32_t DDPF_FOURCC = 0x4;
+
+const uint32_t DDSCAPS_COMPLEX = 0x8;
+const uint32_t DDSCAPS_TEXTURE = 0x1000;
+const uint32_t DDSCAPS_MIPMAP = 0x400000;
+
+const uint32_t DDS_FOURCC_DXT1 = 0x31545844;   // "DXT1", BC1
+const uint32_t DDS_FOURCC_DXT5 = 0x35545844;   // "DXT5", BC3
+const uint32_t DDS_FOURCC_DX10 = 0x30315844;   // "DX10", followed by DdsHeaderDx10
+
+const uint32_t DXGI_FORMAT_BC7_UNORM = 98;
+const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+struct DdsPixelFormat
+{
+    uint32_t Size;
+    uint32_t Flags;
+    uint32_t FourCC;
+    uint32_t RgbBitCount;
+    uint32_t RedMask;
+    uint32_t GreenMask;
+    uint32_t BlueMask;
+    uint32_t AlphaMask;
+};
+
+struct DdsHeader
+{
+    uint32_t Size;
+    uint32_t Flags;
+    uint32_t Height;
+    uint32_t Width;
+    uint32_t PitchOrLinearSize;
+    uint32_t Depth;
+    uint32_t MipMapCount;
+    uint32_t Reserved1[11];
+    DdsPixelFormat PixelFormat;
+    uint32_t Caps;
+    uint32_t Caps2;
+    uint32_t Caps3;
+    uint32_t Caps4;
+    uint32_t Reserved2;
+};
+
+struct DdsHeaderDx10
+{
+    uint32_t DxgiFormat;
+    uint32_t ResourceDimension;
+    uint32_t MiscFlag;
+    uint32_t ArraySize;
+    uint32_t MiscFlags2;
+};
+
+// block compressed formats the baker can write
+enum BlockFormat {
+    BLOCK_BC1,
+    BLOCK_BC3,
+    BLOCK_BC7
+};
+
+// bytes of one 4x4 block
+inline size_t BlockBytes(BlockFormat format)
+{
+    return format == BLOCK_BC1 ? 8 : 16;
+}
+
+// bytes of one mip level of the given size
+inline size_t BlockLevelBytes(BlockFormat format, uint32_t width, uint32_t height)
+{
+    size_t blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+    return (blocksWide > 0 ? blocksWide : 1) * (blocksHigh > 0 ? blocksHigh : 1) * BlockBytes(format);
+}
+
+// path of the baked texture for a source image: the same name with a .dds extension
+inline std::string BakedTexturePath(const std::string &filename)
+{
+    size_t dot = filename.find_last_of('.');
+    size_t slash = filename.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return filename + ".dds";
+    return filename.substr(0, dot) + ".dds";
+}
+#endif
@@ -0,0 +1,212 @@
+#ifndef DDSTEXTURE_H
+#define DDSTEXTURE_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ddsformat.h"
+#include "glstate.h"
+
+// A read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() : mData(NULL), mSize(0)
+    {
+    }
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    // returns false when the file doesn't exist or can't be mapped
+    bool Open(const char* filename)
+    {
+        Close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        HANDLE mapping = NULL;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(file);
+        if (!mapping)
+            return false;
+        mData = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        mSize = mData ? (size_t)size.QuadPart : 0;
+#else
+        int file = open(filename, O_RDONLY);
+        if (file < 0)
+            return false;
+        struct stat info;
+        if (fstat(file, &info) == 0 && info.st_size > 0)
+        {
+            void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (data != MAP_FAILED)
+            {
+                mData = (const unsigned char*)data;
+                mSize = (size_t)info.st_size;
+            }
+        }
+        close(file);
+#endif
+        return mData != NULL;
+    }
+
+    void Close()
+    {
+        if (!mData)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(mData);
+#else
+        munmap((void*)mData, mSize);
+#endif
+        mData = NULL;
+        mSize = 0;
+    }
+
+    const unsigned char* Data() const
+    {
+        return mData;
+    }
+
+    size_t Size() const
+    {
+        return mSize;
+    }
+
+private:
+    const unsigned char* mData;
+    size_t mSize;
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+// Uploads a DDS file written by tools/texturebaker with glCompressedTexImage2D, one call per mip level, straight
+// from the mapped file. Returns false without a message when the file doesn't exist, and with one when it can't
+// be used, so callers can fall back to the source image
+inline bool LoadDdsTexture(const char* filename, GLStateCache &state, GLuint &textureId)
+{
+    MappedFile file;
+    if (!file.Open(filename))
+        return false;
+
+    const unsigned char* data = file.Data();
+    size_t offset = sizeof(uint32_t) + sizeof(DdsHeader);
+    uint32_t magic;
+    DdsHeader header;
+    if (file.Size() < offset)
+    {
+        std::cout << "ERROR::DDS::TRUNCATED " << filename << std::endl;
+        return false;
+    }
+    memcpy(&magic, data, sizeof(magic));
+    memcpy(&header, data + sizeof(magic), sizeof(header));
+    if (magic != DDS_MAGIC || header.Size != sizeof(DdsHeader) || !(header.PixelFormat.Flags & DDPF_FOURCC))
+    {
+        std::cout << "ERROR::DDS::NOT_A_COMPRESSED_DDS " << filename << std::endl;
+        return false;
+    }
+
+    BlockFormat format;
+    GLenum internalFormat;
+    if (header.PixelFormat.FourCC == DDS_FOURCC_DXT1)
+    {
+        format = BLOCK_BC1;
+        internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+    else if (header.PixelFormat.FourCC == DDS_FOURCC_DXT5)
+    {
+        format = BLOCK_BC3;
+        internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    }
+    else if (header.PixelFormat.FourCC == DDS_FOURCC_DX10 && file.Size() >= offset + sizeof(DdsHeaderDx10))
+    {
+        DdsHeaderDx10 extension;
+        memcpy(&extension, data + offset, sizeof(extension));
+        offset += sizeof(extension);
+        if (extension.DxgiFormat != DXGI_FORMAT_BC7_UNORM || extension.ResourceDimension != DDS_DIMENSION_TEXTURE2D)
+        {
+            std::cout << "ERROR::DDS::UNSUPPORTED_DXGI_FORMAT " << extension.DxgiFormat << " in " << filename << std::endl;
+            return false;
+        }
+        format = BLOCK_BC7;
+        internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+    else
+    {
+        std::cout << "ERROR::DDS::UNSUPPORTED_FOURCC in " << filename << std::endl;
+        return false;
+    }
+
+    // S3TC is an extension, BPTC is core since 4.2
+    if (format != BLOCK_BC7 && !GLEW_EXT_texture_compression_s3tc)
+    {
+        std::cout << "ERROR::DDS::S3TC_NOT_SUPPORTED, skipping " << filename << std::endl;
+        return false;
+    }
+
+    if (header.Width == 0 || header.Height == 0)
+    {
+        std::cout << "ERROR::DDS::EMPTY_IMAGE " << filename << std::endl;
+        return false;
+    }
+
+    // a full chain has floor(log2(max(Width, Height))) + 1 levels, more than that can't be a valid file
+    uint32_t maxLevels = 1;
+    for (uint32_t size = std::max(header.Width, header.Height); size > 1; size >>= 1)
+        ++maxLevels;
+    if (header.MipMapCount > maxLevels)
+    {
+        std::cout << "ERROR::DDS::TOO_MANY_MIPMAPS " << header.MipMapCount << " in " << filename << std::endl;
+        return false;
+    }
+
+    GLsizei levels = header.MipMapCount > 0 ? (GLsizei)header.MipMapCount : 1;
+    size_t required = offset;
+    for (GLsizei level = 0; level < levels; ++level)
+        required += BlockLevelBytes(format, std::max(header.Width >> level, 1u), std::max(header.Height >> level, 1u));
+    if (file.Size() < required)
+    {
+        std::cout << "ERROR::DDS::TRUNCATED " << filename << std::endl;
+        return false;
+    }
+
+    glGenTextures(1, &textureId);
+    state.BindTextureUnit(0, GL_TEXTURE_2D, textureId);
+    // wrapping and filtering come from the sampler objects in samplers.h
+    // the baked chain may stop before 1x1, only the stored levels are used
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    for (GLsizei level = 0; level < levels; ++level)
+    {
+        GLsizei width = (GLsizei)std::max(header.Width >> level, 1u);
+        GLsizei height = (GLsizei)std::max(header.Height >> level, 1u);
+        size_t bytes = BlockLevelBytes(format, (uint32_t)width, (uint32_t)height);
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, width, height, 0, (GLsizei)bytes, data + offset);
+        offset += bytes;
+    }
+    return true;
+}
+#endif
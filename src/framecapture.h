@@ -0,0 +1,318 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <GL/glew.h>
+#include <stb_image_write.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glsync.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// How captured frames are written out
+enum CaptureFormat {
+    CAPTURE_PNG,    // one frame_NNNNN.png per frame in the output directory
+    CAPTURE_YUV     // raw 8 bit I420 (yuv420p) frames piped to stdout, e.g. into
+                    // ffmpeg -f rawvideo -pix_fmt yuv420p -s WxH -i - out.mp4
+};
+
+// Captures rendered frames without stalling the GL thread. Capture() only queues a glReadPixels into the next
+// buffer of a ring of persistently mapped pixel pack buffers and fences it. Once a fence has signalled the frame is
+// handed to encoder threads, which read the mapped memory directly, so frame N is encoded while frames N+1.. are
+// rendered. The GL thread only waits when it comes round to a buffer whose frame is still being read or encoded
+class FrameCapture
+{
+public:
+    static const unsigned RingSize = 4;
+
+    FrameCapture() : mWidth(0), mHeight(0), mFormat(CAPTURE_PNG), mNext(0), mFrame(0), mWaits(0), mStop(false), mFailed(false)
+    {
+    }
+
+    // maps the ring for frames of width x height and starts the encoders. PNG frames are compressed in parallel,
+    // YUV frames by a single thread since they must reach the stream in order. Needs a current context
+    void Start(GLsizei width, GLsizei height, CaptureFormat format, const std::string &directory)
+    {
+        mWidth = width;
+        mHeight = height;
+        mFormat = format;
+        mDirectory = directory;
+        mNext = mFrame = mWaits = 0;
+        mStop = mFailed = false;
+
+        GLsizeiptr size = (GLsizeiptr)width * height * 4;
+        GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        for (unsigned i = 0; i < RingSize; ++i)
+        {
+            Slot &slot = mSlots[i];
+            glGenBuffers(1, &slot.Buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.Buffer);
+            glBufferStorage(GL_PIXEL_PACK_BUFFER, size, NULL, flags);
+            slot.Memory = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, flags);
+            slot.Fence = 0;
+            slot.Frame = 0;
+            slot.Encoding = false;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+#ifdef _WIN32
+        if (format == CAPTURE_YUV)
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+        unsigned workerCount = 1;
+        if (format == CAPTURE_PNG)
+        {
+            unsigned hardwareThreads = std::thread::hardware_concurrency();
+            workerCount = hardwareThreads > 2 ? hardwareThreads - 1 : 1;
+            if (workerCount > RingSize - 1)
+                workerCount = RingSize - 1;
+        }
+        for (unsigned i = 0; i < workerCount; ++i)
+            mWorkers.push_back(std::thread(&FrameCapture::work, this));
+    }
+
+    // queues the readback of a framebuffer's color buffer, the bound read buffer of the default framebuffer when 0.
+    // Returns false once an encoder failed to write a frame
+    bool Capture(GLuint framebuffer)
+    {
+        Slot &slot = mSlots[mNext];
+        if (slot.Fence)
+        {
+            // the ring is full: this buffer still holds a frame the GPU may be writing
+            ++mWaits;
+            WaitForFence(slot.Fence);
+            submit(mNext);
+        }
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (slot.Encoding)
+                ++mWaits;
+            while (slot.Encoding)
+                mSlotFree.wait(lock);
+        }
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.Buffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.Frame = mFrame++;
+        mNext = (mNext + 1) % RingSize;
+
+        // hand over the frames that are already read back, oldest first so the stream stays in order
+        for (unsigned i = 0; i < RingSize; ++i)
+        {
+            unsigned index = (mNext + i) % RingSize;
+            if (!mSlots[index].Fence)
+                continue;
+            if (!FenceSignalled(mSlots[index].Fence))
+                break;
+            submit(index);
+        }
+        return !mFailed;
+    }
+
+    // encodes the frames still in flight, stops the encoders and releases the ring. Returns false when any frame
+    // could not be written
+    bool Finish()
+    {
+        for (unsigned i = 0; i < RingSize; ++i)
+        {
+            unsigned index = (mNext + i) % RingSize;
+            if (!mSlots[index].Fence)
+                continue;
+            WaitForFence(mSlots[index].Fence);
+            submit(index);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mJobReady.notify_all();
+        for (size_t i = 0; i < mWorkers.size(); ++i)
+            mWorkers[i].join();
+        mWorkers.clear();
+        if (mFormat == CAPTURE_YUV)
+            fflush(stdout);
+
+        for (unsigned i = 0; i < RingSize; ++i)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, mSlots[i].Buffer);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glDeleteBuffers(1, &mSlots[i].Buffer);
+            mSlots[i].Buffer = 0;
+            mSlots[i].Memory = NULL;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return !mFailed;
+    }
+
+    // frames captured so far
+    unsigned Frames() const
+    {
+        return mFrame;
+    }
+
+    // times Capture had to wait for the GPU or an encoder. Stays near 0 while capture keeps up with rendering
+    unsigned Waits() const
+    {
+        return mWaits;
+    }
+
+private:
+    struct Slot
+    {
+        GLuint Buffer;
+        const unsigned char* Memory;   // persistently mapped, RGBA rows bottom first
+        GLsync Fence;                  // set while the readback may be in flight, touched by the GL thread only
+        unsigned Frame;
+        bool Encoding;                 // guarded by mMutex
+    };
+
+    Slot mSlots[RingSize];
+    GLsizei mWidth;
+    GLsizei mHeight;
+    CaptureFormat mFormat;
+    std::string mDirectory;
+    unsigned mNext;    // slot the next frame is read into, also the oldest one in flight
+    unsigned mFrame;
+    unsigned mWaits;
+
+    std::vector<std::thread> mWorkers;
+    std::deque<unsigned> mJobs;
+    std::mutex mMutex;
+    std::condition_variable mJobReady;
+    std::condition_variable mSlotFree;
+    bool mStop;         // guarded by mMutex
+    std::atomic<bool> mFailed;
+
+    // the readback of a slot is complete, queue it for encoding
+    void submit(unsigned index)
+    {
+        Slot &slot = mSlots[index];
+        glDeleteSync(slot.Fence);
+        slot.Fence = 0;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            slot.Encoding = true;
+            mJobs.push_back(index);
+        }
+        mJobReady.notify_one();
+    }
+
+    // worker loop: encode one frame at a time until Finish() and the queue is drained
+    void work()
+    {
+        std::vector<unsigned char> scratch;
+        for (;;)
+        {
+            unsigned index;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                while (!mStop && mJobs.empty())
+                    mJobReady.wait(lock);
+                if (mJobs.empty())
+                    return;
+                index = mJobs.front();
+                mJobs.pop_front();
+            }
+
+            const Slot &slot = mSlots[index];
+            bool written = mFormat == CAPTURE_PNG ? writePng(slot, scratch) : writeYuv(slot, scratch);
+            if (!written)
+                mFailed = true;
+
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mSlots[index].Encoding = false;
+            }
+            mSlotFree.notify_all();
+        }
+    }
+
+    // flips the frame top row first into scratch, dropping alpha, and compresses it
+    bool writePng(const Slot &slot, std::vector<unsigned char> &scratch) const
+    {
+        scratch.resize((size_t)mWidth * mHeight * 3);
+        unsigned char* destination = scratch.data();
+        for (GLsizei y = mHeight - 1; y >= 0; --y)
+        {
+            const unsigned char* source = slot.Memory + (size_t)y * mWidth * 4;
+            for (GLsizei x = 0; x < mWidth; ++x, source += 4, destination += 3)
+            {
+                destination[0] = source[0];
+                destination[1] = source[1];
+                destination[2] = source[2];
+            }
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "/frame_%05u.png", slot.Frame);
+        std::string filename = mDirectory + name;
+        if (!stbi_write_png(filename.c_str(), mWidth, mHeight, 3, scratch.data(), mWidth * 3))
+        {
+            std::cout << "ERROR::FRAMECAPTURE::WRITE_FAILED " << filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // converts the frame to limited range BT.601 I420, a full resolution Y plane followed by U and V at half
+    // resolution, and appends it to stdout. Odd sizes are cropped to even ones
+    bool writeYuv(const Slot &slot, std::vector<unsigned char> &scratch) const
+    {
+        GLsizei width = mWidth & ~1, height = mHeight & ~1;
+        size_t lumaBytes = (size_t)width * height;
+        scratch.resize(lumaBytes + lumaBytes / 2);
+        unsigned char* lumaPlane = scratch.data();
+        unsigned char* uPlane = lumaPlane + lumaBytes;
+        unsigned char* vPlane = uPlane + lumaBytes / 4;
+
+        for (GLsizei y = 0; y < height; ++y)
+        {
+            const unsigned char* source = slot.Memory + (size_t)(mHeight - 1 - y) * mWidth * 4;
+            unsigned char* luma = lumaPlane + (size_t)y * width;
+            for (GLsizei x = 0; x < width; ++x, source += 4)
+                luma[x] = (unsigned char)(((66 * source[0] + 129 * source[1] + 25 * source[2] + 128) >> 8) + 16);
+        }
+        for (GLsizei y = 0; y < height; y += 2)
+        {
+            const unsigned char* top = slot.Memory + (size_t)(mHeight - 1 - y) * mWidth * 4;
+            const unsigned char* bottom = top - (size_t)mWidth * 4;
+            unsigned char* u = uPlane + (size_t)(y / 2) * (width / 2);
+            unsigned char* v = vPlane + (size_t)(y / 2) * (width / 2);
+            for (GLsizei x = 0; x < width; x += 2, top += 8, bottom += 8)
+            {
+                // average the 2x2 block
+                int r = (top[0] + top[4] + bottom[0] + bottom[4] + 2) / 4;
+                int g = (top[1] + top[5] + bottom[1] + bottom[5] + 2) / 4;
+                int b = (top[2] + top[6] + bottom[2] + bottom[6] + 2) / 4;
+                *u++ = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+                *v++ = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+            }
+        }
+
+        if (fwrite(scratch.data(), 1, scratch.size(), stdout) != scratch.size())
+        {
+            std::cout << "ERROR::FRAMECAPTURE::WRITE_FAILED stdout" << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+#endif
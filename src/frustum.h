@@ -0,0 +1,170 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+// World-space axis-aligned boxes stored as separate center and half-extent arrays, so four boxes can be loaded
+// into one SIMD register per component
+struct BoundsList
+{
+    std::vector<float> CenterX, CenterY, CenterZ;
+    std::vector<float> ExtentX, ExtentY, ExtentZ;
+
+    size_t Size() const
+    {
+        return CenterX.size();
+    }
+
+    void Resize(size_t count)
+    {
+        CenterX.resize(count);
+        CenterY.resize(count);
+        CenterZ.resize(count);
+        ExtentX.resize(count);
+        ExtentY.resize(count);
+        ExtentZ.resize(count);
+    }
+
+    void Set(size_t i, const glm::vec3 &center, const glm::vec3 &extent)
+    {
+        CenterX[i] = center.x;
+        CenterY[i] = center.y;
+        CenterZ[i] = center.z;
+        ExtentX[i] = extent.x;
+        ExtentY[i] = extent.y;
+        ExtentZ[i] = extent.z;
+    }
+};
+
+// The six clip planes of a view-projection matrix, pointing inwards. Planes are read straight from the rows of
+// the matrix (Gribb and Hartmann), which holds for perspective and orthographic projections alike
+class Frustum
+{
+public:
+    enum Plane { LEFT, RIGHT, BOTTOM, TOP, NEAR_PLANE, FAR_PLANE, PLANE_COUNT };
+
+    // xyz is the unit normal and w the distance, a point p is inside when dot(xyz, p) + w >= 0
+    glm::vec4 Planes[PLANE_COUNT];
+
+    Frustum()
+    {
+        for (int i = 0; i < PLANE_COUNT; ++i)
+            Planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    explicit Frustum(const glm::mat4 &viewProjection)
+    {
+        // glm is column major, so row r of the matrix is (m[0][r], m[1][r], m[2][r], m[3][r])
+        glm::vec4 rows[4];
+        for (int r = 0; r < 4; ++r)
+            rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+
+        Planes[LEFT] = rows[3] + rows[0];
+        Planes[RIGHT] = rows[3] - rows[0];
+        Planes[BOTTOM] = rows[3] + rows[1];
+        Planes[TOP] = rows[3] - rows[1];
+        Planes[NEAR_PLANE] = rows[3] + rows[2];
+        Planes[FAR_PLANE] = rows[3] - rows[2];
+        for (int i = 0; i < PLANE_COUNT; ++i)
+        {
+            float length = glm::length(glm::vec3(Planes[i]));
+            if (length > 0.0f)
+                Planes[i] /= length;
+        }
+    }
+
+    // true unless the sphere lies entirely behind one of the planes
+    bool TestSphere(const glm::vec3 &center, float radius) const
+    {
+        for (int i = 0; i < PLANE_COUNT; ++i)
+            if (glm::dot(glm::vec3(Planes[i]), center) + Planes[i].w < -radius)
+                return false;
+        return true;
+    }
+
+    // true unless the box lies entirely behind one of the planes
+    bool TestBox(const glm::vec3 &center, const glm::vec3 &extent) const
+    {
+        for (int i = 0; i < PLANE_COUNT; ++i)
+        {
+            glm::vec3 normal(Planes[i]);
+            // projected half size of the box onto the plane normal
+            float radius = glm::dot(glm::abs(normal), extent);
+            if (glm::dot(normal, center) + Planes[i].w < -radius)
+                return false;
+        }
+        return true;
+    }
+
+    // appends to visible the index of every box that is at least partly inside, in increasing order.
+    // Boxes are tested four at a time with SSE when it is available
+    void Cull(const BoundsList &bounds, std::vector<uint32_t> &visible) const
+    {
+        Cull(bounds, 0, bounds.Size(), visible);
+    }
+
+    // same for the boxes in [begin, end) only, so that parts of a list can be culled on different threads
+    void Cull(const BoundsList &bounds, size_t begin, size_t end, std::vector<uint32_t> &visible) const
+    {
+        const size_t count = end;
+        size_t i = begin;
+#ifdef FRUSTUM_SSE
+        __m128 normalX[PLANE_COUNT], normalY[PLANE_COUNT], normalZ[PLANE_COUNT], distance[PLANE_COUNT];
+        __m128 absX[PLANE_COUNT], absY[PLANE_COUNT], absZ[PLANE_COUNT];
+        for (int p = 0; p < PLANE_COUNT; ++p)
+        {
+            normalX[p] = _mm_set1_ps(Planes[p].x);
+            normalY[p] = _mm_set1_ps(Planes[p].y);
+            normalZ[p] = _mm_set1_ps(Planes[p].z);
+            distance[p] = _mm_set1_ps(Planes[p].w);
+            absX[p] = _mm_set1_ps(fabsf(Planes[p].x));
+            absY[p] = _mm_set1_ps(fabsf(Planes[p].y));
+            absZ[p] = _mm_set1_ps(fabsf(Planes[p].z));
+        }
+
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 centerX = _mm_loadu_ps(&bounds.CenterX[i]);
+            __m128 centerY = _mm_loadu_ps(&bounds.CenterY[i]);
+            __m128 centerZ = _mm_loadu_ps(&bounds.CenterZ[i]);
+            __m128 extentX = _mm_loadu_ps(&bounds.ExtentX[i]);
+            __m128 extentY = _mm_loadu_ps(&bounds.ExtentY[i]);
+            __m128 extentZ = _mm_loadu_ps(&bounds.ExtentZ[i]);
+
+            __m128 outside = _mm_setzero_ps();
+            for (int p = 0; p < PLANE_COUNT; ++p)
+            {
+                __m128 signedDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX[p], centerX), _mm_mul_ps(normalY[p], centerY)),
+                                                   _mm_add_ps(_mm_mul_ps(normalZ[p], centerZ), distance[p]));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], extentX), _mm_mul_ps(absY[p], extentY)), _mm_mul_ps(absZ[p], extentZ));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(signedDistance, radius), zero));
+            }
+
+            int outsideMask = _mm_movemask_ps(outside);
+            for (int lane = 0; lane < 4; ++lane)
+                if (!(outsideMask & (1 << lane)))
+                    visible.push_back((uint32_t)(i + lane));
+        }
+#endif
+        // the boxes left over after the last group of four, or all of them without SSE
+        for (; i < count; ++i)
+        {
+            glm::vec3 center(bounds.CenterX[i], bounds.CenterY[i], bounds.CenterZ[i]);
+            glm::vec3 extent(bounds.ExtentX[i], bounds.ExtentY[i], bounds.ExtentZ[i]);
+            if (TestBox(center, extent))
+                visible.push_back((uint32_t)i);
+        }
+    }
+};
+#endif
@@ -0,0 +1,260 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/glew.h>
+
+#include <iostream>
+#include <vector>
+
+// Kinds of state changes tracked by GLStateCache
+enum GLStateCall {
+    STATE_PROGRAM,
+    STATE_VERTEX_ARRAY,
+    STATE_ACTIVE_TEXTURE,
+    STATE_TEXTURE,
+    STATE_SAMPLER,
+    STATE_CAPABILITY,
+    STATE_CLEAR_COLOR,
+    STATE_CALL_COUNT
+};
+
+// Remembers the current program, VAO, texture and sampler bindings, enable bits and clear color and drops calls that would
+// set a value that is already current. Code that changes GL state behind its back must call Invalidate()
+class GLStateCache
+{
+public:
+    static const GLuint MaxTextureUnits = 32;
+
+    GLStateCache()
+    {
+        Invalidate();
+        ResetCounters();
+    }
+
+    // forgets everything, so the next call of every kind reaches GL
+    void Invalidate()
+    {
+        mProgram = Unknown;
+        mVertexArray = Unknown;
+        mActiveUnit = Unknown;
+        for (GLuint unit = 0; unit < MaxTextureUnits; ++unit)
+            for (int slot = 0; slot < TargetSlotCount; ++slot)
+                mTextures[unit][slot] = Unknown;
+        for (GLuint unit = 0; unit < MaxTextureUnits; ++unit)
+            mSamplers[unit] = Unknown;
+        mCapabilities.clear();
+        mClearColorKnown = false;
+    }
+
+    void UseProgram(GLuint program)
+    {
+        if (track(STATE_PROGRAM, mProgram == program))
+            return;
+        mProgram = program;
+        glUseProgram(program);
+    }
+
+    void BindVertexArray(GLuint vertexArray)
+    {
+        if (track(STATE_VERTEX_ARRAY, mVertexArray == vertexArray))
+            return;
+        mVertexArray = vertexArray;
+        glBindVertexArray(vertexArray);
+    }
+
+    // unit is GL_TEXTURE0 + n, as for glActiveTexture
+    void ActiveTexture(GLenum unit)
+    {
+        if (track(STATE_ACTIVE_TEXTURE, mActiveUnit == unit))
+            return;
+        mActiveUnit = unit;
+        glActiveTexture(unit);
+    }
+
+    // binds a texture on the active unit. Targets other than 2D, 2D array and cube maps are passed straight through
+    void BindTexture(GLenum target, GLuint texture)
+    {
+        int slot = targetSlot(target);
+        GLuint unit = mActiveUnit - GL_TEXTURE0;
+        if (slot < 0 || mActiveUnit == Unknown || unit >= MaxTextureUnits)
+        {
+            track(STATE_TEXTURE, false);
+            glBindTexture(target, texture);
+            return;
+        }
+        if (track(STATE_TEXTURE, mTextures[unit][slot] == texture))
+            return;
+        mTextures[unit][slot] = texture;
+        glBindTexture(target, texture);
+    }
+
+    // selects a unit by number and binds a texture on it
+    void BindTextureUnit(GLuint unit, GLenum target, GLuint texture)
+    {
+        ActiveTexture(GL_TEXTURE0 + unit);
+        BindTexture(target, texture);
+    }
+
+    // binds a sampler object on a unit by number, 0 goes back to the texture's own parameters
+    void BindSampler(GLuint unit, GLuint sampler)
+    {
+        if (unit >= MaxTextureUnits)
+        {
+            track(STATE_SAMPLER, false);
+            glBindSampler(unit, sampler);
+            return;
+        }
+        if (track(STATE_SAMPLER, mSamplers[unit] == sampler))
+            return;
+        mSamplers[unit] = sampler;
+        glBindSampler(unit, sampler);
+    }
+
+    // tells the cache a texture was deleted so a new object reusing its name isn't mistaken for it
+    void ForgetTexture(GLuint texture)
+    {
+        for (GLuint unit = 0; unit < MaxTextureUnits; ++unit)
+            for (int slot = 0; slot < TargetSlotCount; ++slot)
+                if (mTextures[unit][slot] == texture)
+                    mTextures[unit][slot] = Unknown;
+    }
+
+    void Enable(GLenum capability)
+    {
+        setCapability(capability, true);
+    }
+
+    void Disable(GLenum capability)
+    {
+        setCapability(capability, false);
+    }
+
+    void ClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+    {
+        bool same = mClearColorKnown && mClearColor[0] == red && mClearColor[1] == green && mClearColor[2] == blue && mClearColor[3] == alpha;
+        if (track(STATE_CLEAR_COLOR, same))
+            return;
+        mClearColorKnown = true;
+        mClearColor[0] = red;
+        mClearColor[1] = green;
+        mClearColor[2] = blue;
+        mClearColor[3] = alpha;
+        glClearColor(red, green, blue, alpha);
+    }
+
+    // calls that reached GL and calls that were dropped, per kind and in total
+    unsigned Issued(GLStateCall call) const
+    {
+        return mIssued[call];
+    }
+
+    unsigned Dropped(GLStateCall call) const
+    {
+        return mDropped[call];
+    }
+
+    unsigned Issued() const
+    {
+        unsigned total = 0;
+        for (int i = 0; i < STATE_CALL_COUNT; ++i)
+            total += mIssued[i];
+        return total;
+    }
+
+    unsigned Dropped() const
+    {
+        unsigned total = 0;
+        for (int i = 0; i < STATE_CALL_COUNT; ++i)
+            total += mDropped[i];
+        return total;
+    }
+
+    void ResetCounters()
+    {
+        for (int i = 0; i < STATE_CALL_COUNT; ++i)
+            mIssued[i] = mDropped[i] = 0;
+    }
+
+    // prints the counters, one line per kind of call
+    void Report(std::ostream &out) const
+    {
+        static const char* const names[STATE_CALL_COUNT] = { "program", "vertex array", "active texture", "texture", "sampler", "capability", "clear color" };
+        out << "INFO: GL state cache dropped " << Dropped() << " of " << Issued() + Dropped() << " calls" << std::endl;
+        for (int i = 0; i < STATE_CALL_COUNT; ++i)
+            out << "    " << names[i] << ": " << mDropped[i] << " dropped, " << mIssued[i] << " issued" << std::endl;
+    }
+
+private:
+    static const GLuint Unknown = ~0u;
+    static const int TargetSlotCount = 3;
+
+    struct Capability
+    {
+        GLenum Name;
+        bool   Enabled;
+    };
+
+    GLuint mProgram;
+    GLuint mVertexArray;
+    GLenum mActiveUnit;
+    GLuint mTextures[MaxTextureUnits][TargetSlotCount];
+    GLuint mSamplers[MaxTextureUnits];
+    std::vector<Capability> mCapabilities;
+    bool mClearColorKnown;
+    GLfloat mClearColor[4];
+    unsigned mIssued[STATE_CALL_COUNT];
+    unsigned mDropped[STATE_CALL_COUNT];
+
+    // counts a call and returns true when it is redundant and must be dropped
+    bool track(GLStateCall call, bool redundant)
+    {
+        if (redundant)
+            ++mDropped[call];
+        else
+            ++mIssued[call];
+        return redundant;
+    }
+
+    static int targetSlot(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_TEXTURE_2D:
+                return 0;
+            case GL_TEXTURE_2D_ARRAY:
+                return 1;
+            case GL_TEXTURE_CUBE_MAP:
+                return 2;
+            default:
+                return -1;
+        }
+    }
+
+    void setCapability(GLenum capability, bool enabled)
+    {
+        for (size_t i = 0; i < mCapabilities.size(); ++i)
+        {
+            if (mCapabilities[i].Name != capability)
+                continue;
+            if (track(STATE_CAPABILITY, mCapabilities[i].Enabled == enabled))
+                return;
+            mCapabilities[i].Enabled = enabled;
+            applyCapability(capability, enabled);
+            return;
+        }
+
+        track(STATE_CAPABILITY, false);
+        Capability entry = { capability, enabled };
+        mCapabilities.push_back(entry);
+        applyCapability(capability, enabled);
+    }
+
+    static void applyCapability(GLenum capability, bool enabled)
+    {
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+};
+#endif
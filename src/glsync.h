@@ -0,0 +1,36 @@
+#ifndef GLSYNC_H
+#define GLSYNC_H
+
+#include <GL/glew.h>
+
+#include <iostream>
+
+// true once the GPU has passed the fence, without blocking
+inline bool FenceSignalled(GLsync fence)
+{
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+// blocks until the GPU has passed the fence. A timed out wait is simply repeated, memory guarded by the fence must
+// not be reused before it signals. When the wait itself fails the GPU is drained with glFinish instead, which
+// passes every fence as well
+inline void WaitForFence(GLsync fence)
+{
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    for (;;)
+    {
+        GLenum status = glClientWaitSync(fence, flags, GLuint64(1000000000));
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+            return;
+        if (status == GL_WAIT_FAILED)
+        {
+            std::cout << "ERROR::GLSYNC::WAIT_FAILED" << std::endl;
+            glFinish();
+            return;
+        }
+        // the commands were flushed by the first wait
+        flags = 0;
+    }
+}
+#endif
@@ -0,0 +1,39 @@
+#ifndef IMAGEFLIP_H
+#define IMAGEFLIP_H
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it.
+// Whole rows are swapped through one scratch row with memcpy, which the C library vectorizes
+inline void flipImageVertically(unsigned char *image, int width, int height, int channels)
+{
+    const size_t rowBytes = (size_t)width * channels;
+    std::vector<unsigned char> scratch(rowBytes);
+    unsigned char* top = image;
+    unsigned char* bottom = image + (size_t)(height - 1) * rowBytes;
+    for (int j = 0; j < height / 2; ++j)
+    {
+        memcpy(scratch.data(), top, rowBytes);
+        memcpy(top, bottom, rowBytes);
+        memcpy(bottom, scratch.data(), rowBytes);
+        top += rowBytes;
+        bottom -= rowBytes;
+    }
+}
+
+// copies an image into destination with its rows in reverse order. Used when the pixels have to be copied anyway,
+// for example into a staging buffer, so the flip costs nothing extra
+inline void copyImageFlipped(unsigned char *destination, const unsigned char *image, int width, int height, int channels)
+{
+    const size_t rowBytes = (size_t)width * channels;
+    const unsigned char* source = image + (size_t)(height - 1) * rowBytes;
+    for (int j = 0; j < height; ++j)
+    {
+        memcpy(destination, source, rowBytes);
+        destination += rowBytes;
+        source -= rowBytes;
+    }
+}
+#endif
@@ -0,0 +1,188 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Splits loops over many objects across cores. ParallelFor cuts a range into fixed size chunks and deals them out
+// to one queue per thread, the calling thread included. Each thread takes work from the back of its own queue and,
+// once that is empty, steals from the front of the others', so threads that finish early take over the chunks of
+// slower ones. Chunks are numbered in order, which lets every chunk write its own output and the caller combine
+// them in a fixed order whatever thread ran them. ParallelFor must not be called from inside a chunk
+class JobSystem
+{
+public:
+    // runs one chunk: its number and the part [begin, end) of the range it covers
+    typedef std::function<void(size_t chunk, size_t begin, size_t end)> ChunkFunction;
+
+    JobSystem() : mStop(false), mQueued(0)
+    {
+    }
+
+    // starts the workers. A workerCount of 0 uses every hardware thread but the calling one
+    void Start(unsigned workerCount = 0)
+    {
+        if (workerCount == 0)
+        {
+            unsigned hardwareThreads = std::thread::hardware_concurrency();
+            workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+        }
+
+        mStop = false;
+        mQueues.clear();
+        // queue 0 belongs to the thread calling ParallelFor
+        for (unsigned i = 0; i <= workerCount; ++i)
+            mQueues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+        for (unsigned i = 1; i <= workerCount; ++i)
+            mWorkers.push_back(std::thread(&JobSystem::work, this, i));
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mWakeMutex);
+            mStop = true;
+        }
+        mWake.notify_all();
+        for (size_t i = 0; i < mWorkers.size(); ++i)
+            mWorkers[i].join();
+        mWorkers.clear();
+        mQueues.clear();
+    }
+
+    // threads running chunks, the calling thread included
+    unsigned ThreadCount() const
+    {
+        return (unsigned)mWorkers.size() + 1;
+    }
+
+    // number of chunks ParallelFor cuts count items into
+    static size_t ChunkCount(size_t count, size_t chunkSize)
+    {
+        return (count + chunkSize - 1) / chunkSize;
+    }
+
+    // runs function on every chunk of chunkSize items of [0, count) and returns once all of them are done. A range
+    // of a single chunk runs on the calling thread without touching the queues
+    void ParallelFor(size_t count, size_t chunkSize, const ChunkFunction &function)
+    {
+        size_t chunks = ChunkCount(count, chunkSize);
+        if (chunks == 0)
+            return;
+        if (chunks == 1 || mWorkers.empty())
+        {
+            for (size_t chunk = 0; chunk < chunks; ++chunk)
+                function(chunk, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+            return;
+        }
+
+        // counted before they are queued, so the count never drops below the jobs actually queued
+        std::atomic<size_t> remaining(chunks);
+        {
+            std::lock_guard<std::mutex> lock(mWakeMutex);
+            mQueued += chunks;
+        }
+        for (size_t chunk = 0; chunk < chunks; ++chunk)
+        {
+            Job job = { &function, &remaining, chunk, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize) };
+            WorkQueue &queue = *mQueues[chunk % mQueues.size()];
+            std::lock_guard<std::mutex> lock(queue.Mutex);
+            queue.Jobs.push_back(job);
+        }
+        mWake.notify_all();
+
+        // help until every chunk is done, the last ones may still be running on workers
+        Job job;
+        while (remaining.load(std::memory_order_acquire) > 0)
+        {
+            if (take(0, job))
+                run(job);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    struct Job
+    {
+        const ChunkFunction* Function;
+        std::atomic<size_t>* Remaining;
+        size_t Chunk;
+        size_t Begin;
+        size_t End;
+    };
+
+    struct WorkQueue
+    {
+        std::mutex Mutex;
+        std::deque<Job> Jobs;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> mQueues;
+    std::vector<std::thread> mWorkers;
+    std::mutex mWakeMutex;
+    std::condition_variable mWake;
+    bool mStop;         // guarded by mWakeMutex
+    size_t mQueued;     // jobs in all queues, guarded by mWakeMutex
+
+    // takes a job from the back of the thread's own queue, or steals one from the front of another queue
+    bool take(size_t self, Job &job)
+    {
+        for (size_t i = 0; i < mQueues.size(); ++i)
+        {
+            size_t index = (self + i) % mQueues.size();
+            WorkQueue &queue = *mQueues[index];
+            std::lock_guard<std::mutex> lock(queue.Mutex);
+            if (queue.Jobs.empty())
+                continue;
+            if (index == self)
+            {
+                job = queue.Jobs.back();
+                queue.Jobs.pop_back();
+            }
+            else
+            {
+                job = queue.Jobs.front();
+                queue.Jobs.pop_front();
+            }
+            std::lock_guard<std::mutex> wakeLock(mWakeMutex);
+            --mQueued;
+            return true;
+        }
+        return false;
+    }
+
+    static void run(const Job &job)
+    {
+        (*job.Function)(job.Chunk, job.Begin, job.End);
+        job.Remaining->fetch_sub(1, std::memory_order_release);
+    }
+
+    // worker loop: run and steal jobs, sleep while every queue is empty
+    void work(size_t self)
+    {
+        Job job;
+        for (;;)
+        {
+            if (take(self, job))
+            {
+                run(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mWakeMutex);
+            while (!mStop && mQueued == 0)
+                mWake.wait(lock);
+            if (mStop)
+                return;
+        }
+    }
+};
+#endif
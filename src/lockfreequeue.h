@@ -0,0 +1,98 @@
+#ifndef LOCKFREEQUEUE_H
+#define LOCKFREEQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded multi-producer multi-consumer queue (Dmitry Vyukov's design). Every cell carries a sequence number that
+// tells producers and consumers whether it is free or filled for their lap around the ring, so pushing and popping
+// only take one compare-and-swap on the shared position and never block
+template <class T>
+class LockFreeQueue
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit LockFreeQueue(size_t capacity = 64) : mEnqueuePos(0), mDequeuePos(0)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        mMask = size - 1;
+        mCells = std::vector<Cell>(size);
+        for (size_t i = 0; i < size; ++i)
+            mCells[i].Sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // returns false when the queue is full
+    bool TryPush(const T &value)
+    {
+        size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = mCells[pos & mMask];
+            size_t sequence = cell.Sequence.load(std::memory_order_acquire);
+            ptrdiff_t difference = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+            if (difference == 0)
+            {
+                if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.Value = value;
+                    cell.Sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+                return false;
+            else
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    // returns false when the queue is empty
+    bool TryPop(T &value)
+    {
+        size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = mCells[pos & mMask];
+            size_t sequence = cell.Sequence.load(std::memory_order_acquire);
+            ptrdiff_t difference = (ptrdiff_t)sequence - (ptrdiff_t)(pos + 1);
+            if (difference == 0)
+            {
+                if (mDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = cell.Value;
+                    cell.Sequence.store(pos + mMask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+                return false;
+            else
+                pos = mDequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> Sequence;
+        T Value;
+
+        Cell() : Sequence(0), Value()
+        {
+        }
+
+        Cell(const Cell &other) : Sequence(other.Sequence.load(std::memory_order_relaxed)), Value(other.Value)
+        {
+        }
+    };
+
+    std::vector<Cell> mCells;
+    size_t mMask;
+    // producers and consumers each get their own cache line
+    alignas(64) std::atomic<size_t> mEnqueuePos;
+    alignas(64) std::atomic<size_t> mDequeuePos;
+};
+#endif
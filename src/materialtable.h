@@ -0,0 +1,324 @@
+#ifndef MATERIALTABLE_H
+#define MATERIALTABLE_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <vector>
+
+#include "glstate.h"
+#include "samplers.h"
+
+// Per-material data read by the fragment shader, matches the std430 MaterialData struct
+struct MaterialData
+{
+    GLuint64 Handle;    // bindless texture handle, 0 when textures come from the array
+    GLuint   Layer;     // layer of the texture array
+    GLuint   Sampler;   // SamplerWrap of the material
+    GLfloat  Color[4];  // surface color, multiplied by the texture in textured shader variants
+    GLfloat  AmbientStrength;
+    GLfloat  SpecularIntensity;
+    GLfloat  HighlightSize;
+    GLfloat  Padding;
+};
+
+// Makes every material texture reachable from a single draw, so texture binds no longer split batches. With
+// ARB_bindless_texture each material stores a resident handle pairing its texture with one of the shared samplers.
+// Otherwise the textures are resampled into the layers of one GL_TEXTURE_2D_ARRAY of LayerSize x LayerSize, each
+// material stores its layer and the shader applies the material's wrap mode itself, since a draw can only sample
+// the array through one sampler. Either way the materials live in an SSBO indexed by the per-object material index.
+// Textures whose contents change later (streamed textures) must be passed to Refresh once they are final
+class MaterialTable
+{
+public:
+    // SSBO binding point of the MaterialData array
+    static const GLuint MaterialBinding = 1;
+    // width and height of every array layer
+    static const GLsizei LayerSize = 1024;
+
+    MaterialTable() : mBindless(false), mMaxLayers(0), mSamplers(NULL), mArray(0), mBuffer(0), mPlaceholder(0), mPlaceholderHandle(0),
+        mCopyProgram(0), mCopyVao(0), mCopyFramebuffer(0), mDirty(false)
+    {
+    }
+
+    // creates the storage for up to maxLayers textures, sampled through samplers. Bindless handles are used when
+    // the extension is present unless allowBindless is false
+    void Create(GLuint maxLayers, const SamplerSet &samplers, bool allowBindless = true)
+    {
+        mBindless = allowBindless && GLEW_ARB_bindless_texture;
+        mMaxLayers = maxLayers > 0 ? maxLayers : 1;
+        mSamplers = &samplers;
+        glGenBuffers(1, &mBuffer);
+
+        if (mBindless)
+        {
+            // materials point at a white texel until their texture is final, a texture can't change once it has a handle
+            static const unsigned char white[4] = { 255, 255, 255, 255 };
+            glGenTextures(1, &mPlaceholder);
+            glBindTexture(GL_TEXTURE_2D, mPlaceholder);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, white);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            mPlaceholderHandle = glGetTextureHandleARB(mPlaceholder);
+            glMakeTextureHandleResidentARB(mPlaceholderHandle);
+            std::cout << "INFO: materials use bindless textures" << std::endl;
+            return;
+        }
+
+        GLsizei levels = 1;
+        while ((LayerSize >> levels) > 0)
+            ++levels;
+        glGenTextures(1, &mArray);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, mArray);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, LayerSize, LayerSize, (GLsizei)mMaxLayers);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        // layers start out white, like the placeholder of a texture that is still loading
+        static const unsigned char white[4] = { 255, 255, 255, 255 };
+        for (GLsizei level = 0; level < levels; ++level)
+            glClearTexImage(mArray, level, GL_RGBA, GL_UNSIGNED_BYTE, white);
+
+        createCopyProgram();
+        std::cout << "INFO: materials use a " << LayerSize << "x" << LayerSize << " texture array with " << mMaxLayers << " layers" << std::endl;
+    }
+
+    void Destroy()
+    {
+        if (mBindless)
+        {
+            // materials pairing the same texture and sampler share a handle, release it only once
+            for (size_t i = 0; i < mMaterials.size(); ++i)
+                if (mMaterials[i].Handle != mPlaceholderHandle && glIsTextureHandleResidentARB(mMaterials[i].Handle))
+                    glMakeTextureHandleNonResidentARB(mMaterials[i].Handle);
+            if (mPlaceholderHandle)
+                glMakeTextureHandleNonResidentARB(mPlaceholderHandle);
+        }
+        glDeleteTextures(1, &mPlaceholder);
+        glDeleteTextures(1, &mArray);
+        glDeleteBuffers(1, &mBuffer);
+        glDeleteProgram(mCopyProgram);
+        glDeleteVertexArrays(1, &mCopyVao);
+        glDeleteFramebuffers(1, &mCopyFramebuffer);
+        mPlaceholder = mArray = mBuffer = mCopyProgram = mCopyVao = mCopyFramebuffer = 0;
+        mPlaceholderHandle = 0;
+        mSamplers = NULL;
+        mMaterials.clear();
+        mTextures.clear();
+    }
+
+    // adds a material showing a texture with the given wrap mode and returns its index. Materials sharing a texture
+    // share its layer, and its handle when they also share the wrap mode. The material shows white until Refresh
+    // is called for the texture. Untextured materials pass 0. Shading starts out white and matches SetShading's
+    // defaults
+    GLuint Add(GLuint textureId, SamplerWrap wrap = SAMPLER_REPEAT)
+    {
+        MaterialData material;
+        material.Handle = mBindless ? mPlaceholderHandle : 0;
+        material.Layer = 0;
+        material.Sampler = (GLuint)wrap;
+        material.Color[0] = material.Color[1] = material.Color[2] = material.Color[3] = 1.0f;
+        material.AmbientStrength = 0.2f;
+        material.SpecularIntensity = 0.2f;
+        material.HighlightSize = 16.0f;
+        material.Padding = 0.0f;
+
+        bool found = false;
+        for (size_t i = 0; i < mTextures.size(); ++i)
+            if (mTextures[i] == textureId)
+            {
+                material.Layer = mMaterials[i].Layer;
+                if (mMaterials[i].Sampler == material.Sampler)
+                    material.Handle = mMaterials[i].Handle;
+                found = true;
+            }
+        if (!found && !mBindless && textureId != 0)
+        {
+            GLuint usedLayers = 0;
+            for (size_t i = 0; i < mMaterials.size(); ++i)
+                usedLayers = mMaterials[i].Layer + 1 > usedLayers ? mMaterials[i].Layer + 1 : usedLayers;
+            if (usedLayers >= mMaxLayers)
+                std::cout << "ERROR::MATERIALTABLE::OUT_OF_LAYERS, texture " << textureId << " shares the last layer" << std::endl;
+            material.Layer = usedLayers < mMaxLayers ? usedLayers : mMaxLayers - 1;
+        }
+
+        mMaterials.push_back(material);
+        mTextures.push_back(textureId);
+        mDirty = true;
+        return (GLuint)(mMaterials.size() - 1);
+    }
+
+    // sets the color and Phong strengths of a material
+    void SetShading(GLuint material, const glm::vec4 &color, float ambientStrength = 0.2f, float specularIntensity = 0.2f, float highlightSize = 16.0f)
+    {
+        if (material >= mMaterials.size())
+            return;
+        MaterialData &data = mMaterials[material];
+        for (int i = 0; i < 4; ++i)
+            data.Color[i] = color[i];
+        data.AmbientStrength = ambientStrength;
+        data.SpecularIntensity = specularIntensity;
+        data.HighlightSize = highlightSize;
+        mDirty = true;
+    }
+
+    // picks up the final contents of a texture: makes its handles resident, or copies it into its layer
+    void Refresh(GLuint textureId, GLStateCache &state)
+    {
+        if (textureId == 0)
+            return;
+        size_t first = 0;
+        while (first < mTextures.size() && mTextures[first] != textureId)
+            ++first;
+        if (first == mTextures.size())
+            return;
+
+        if (mBindless)
+        {
+            // GL hands out the same handle for the same texture and sampler, so materials sharing both share it
+            for (size_t i = first; i < mTextures.size(); ++i)
+            {
+                if (mTextures[i] != textureId || mMaterials[i].Handle != mPlaceholderHandle)
+                    continue;
+                GLuint64 handle = glGetTextureSamplerHandleARB(textureId, mSamplers->Get((SamplerWrap)mMaterials[i].Sampler));
+                if (!glIsTextureHandleResidentARB(handle))
+                    glMakeTextureHandleResidentARB(handle);
+                mMaterials[i].Handle = handle;
+            }
+        }
+        else
+            copyToLayer(textureId, mMaterials[first].Layer, state);
+        mDirty = true;
+    }
+
+    // makes the materials available to the next draws: the SSBO, and the array with the repeating sampler on
+    // texture unit 0. The shader wraps the coordinates of other wrap modes into [0, 1) itself
+    void Bind(GLStateCache &state)
+    {
+        if (mDirty)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, mMaterials.size() * sizeof(MaterialData), mMaterials.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            mDirty = false;
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MaterialBinding, mBuffer);
+        if (!mBindless)
+        {
+            state.BindTextureUnit(0, GL_TEXTURE_2D_ARRAY, mArray);
+            state.BindSampler(0, mSamplers->Get(SAMPLER_REPEAT));
+        }
+    }
+
+    bool Bindless() const
+    {
+        return mBindless;
+    }
+
+    size_t Count() const
+    {
+        return mMaterials.size();
+    }
+
+private:
+    bool mBindless;
+    GLuint mMaxLayers;
+    const SamplerSet* mSamplers;
+    GLuint mArray;
+    GLuint mBuffer;
+    GLuint mPlaceholder;
+    GLuint64 mPlaceholderHandle;
+    GLuint mCopyProgram;
+    GLuint mCopyVao;
+    GLuint mCopyFramebuffer;
+    bool mDirty;
+    std::vector<MaterialData> mMaterials;
+    std::vector<GLuint> mTextures;   // texture of each material
+
+    // a full screen triangle sampling the source texture. Drawing rather than blitting lets compressed textures,
+    // which can't be framebuffer attachments, be copied too
+    void createCopyProgram()
+    {
+        const char* vertexSource =
+            "#version 440 core\n"
+            "out vec2 uv;\n"
+            "void main()\n"
+            "{\n"
+            "    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+            "    uv = corner;\n"
+            "    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);\n"
+            "}\n";
+        const char* fragmentSource =
+            "#version 440 core\n"
+            "in vec2 uv;\n"
+            "out vec4 color;\n"
+            "uniform sampler2D source;\n"
+            "void main()\n"
+            "{\n"
+            "    color = texture(source, uv);\n"
+            "}\n";
+
+        GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexSource, NULL);
+        glCompileShader(vertexShader);
+        GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
+        glCompileShader(fragmentShader);
+
+        mCopyProgram = glCreateProgram();
+        glAttachShader(mCopyProgram, vertexShader);
+        glAttachShader(mCopyProgram, fragmentShader);
+        glLinkProgram(mCopyProgram);
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+
+        GLint success = 0;
+        glGetProgramiv(mCopyProgram, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            char infoLog[512];
+            glGetProgramInfoLog(mCopyProgram, sizeof(infoLog), NULL, infoLog);
+            std::cout << "ERROR::MATERIALTABLE::COPY_PROGRAM_LINKING_FAILED\n" << infoLog << std::endl;
+        }
+        // the source is always read from texture unit 0
+        glProgramUniform1i(mCopyProgram, glGetUniformLocation(mCopyProgram, "source"), 0);
+
+        glGenVertexArrays(1, &mCopyVao);
+        glGenFramebuffers(1, &mCopyFramebuffer);
+    }
+
+    // resamples a texture into every mip level of one layer of the array, leaving the other layers alone. The
+    // source is read through the clamping sampler so its own mips filter the downscale and its edges don't bleed
+    // into each other
+    void copyToLayer(GLuint textureId, GLuint layer, GLStateCache &state)
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLint framebuffer = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mCopyFramebuffer);
+        state.Disable(GL_DEPTH_TEST);
+        state.UseProgram(mCopyProgram);
+        state.BindVertexArray(mCopyVao);
+        state.BindTextureUnit(0, GL_TEXTURE_2D, textureId);
+        state.BindSampler(0, mSamplers->Get(SAMPLER_CLAMP));
+        for (GLint level = 0; (LayerSize >> level) > 0; ++level)
+        {
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, mArray, level, (GLint)layer);
+            if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            {
+                std::cout << "ERROR::MATERIALTABLE::LAYER_FRAMEBUFFER_INCOMPLETE" << std::endl;
+                break;
+            }
+            glViewport(0, 0, LayerSize >> level, LayerSize >> level);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)framebuffer);
+
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        if (depthTest)
+            state.Enable(GL_DEPTH_TEST);
+    }
+};
+#endif
@@ -0,0 +1,337 @@
+#ifndef MESHBUILDER_H
+#define MESHBUILDER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Object-space bounding volumes of a mesh
+struct MeshBounds
+{
+    glm::vec3 Min;
+    glm::vec3 Max;
+    glm::vec3 SphereCenter;
+    float     SphereRadius;
+};
+
+// Geometry produced by MeshBuilder: unique interleaved vertices plus an index buffer
+struct IndexedMesh
+{
+    std::vector<GLfloat>  Vertices;
+    std::vector<GLushort> Indices16;   // filled when every index fits in 16 bits
+    std::vector<GLuint>   Indices32;   // filled otherwise
+    GLenum  IndexType;                 // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    GLuint  VertexCount;
+    GLuint  IndexCount;
+    MeshBounds Bounds;
+
+    const void* IndexData() const
+    {
+        return IndexType == GL_UNSIGNED_SHORT ? (const void*)Indices16.data() : (const void*)Indices32.data();
+    }
+
+    size_t IndexBytes() const
+    {
+        return IndexType == GL_UNSIGNED_SHORT ? Indices16.size() * sizeof(GLushort) : Indices32.size() * sizeof(GLuint);
+    }
+};
+
+// Turns a non-indexed triangle soup into an indexed mesh. Vertices whose attributes are bit-for-bit identical are
+// welded together, degenerate triangles are dropped, triangles are reordered for post-transform vertex cache reuse
+// (Forsyth's linear-speed algorithm) and vertices are finally reordered by first use for linear fetching
+class MeshBuilder
+{
+public:
+    // number of floats in one interleaved vertex
+    GLuint FloatsPerVertex;
+    // size of the simulated post-transform cache
+    int CacheSize;
+
+    MeshBuilder(GLuint floatsPerVertex = 8, int cacheSize = 32) : FloatsPerVertex(floatsPerVertex), CacheSize(cacheSize)
+    {
+    }
+
+    // builds an indexed mesh from vertexCount interleaved vertices forming a GL_TRIANGLES list
+    IndexedMesh Build(const GLfloat* vertices, GLuint vertexCount) const
+    {
+        IndexedMesh mesh;
+        std::vector<GLuint> indices;
+        weld(vertices, vertexCount, mesh.Vertices, indices);
+        removeDegenerates(indices);
+        optimizeVertexCache(indices, mesh.Vertices.size() / FloatsPerVertex);
+        optimizeVertexFetch(mesh.Vertices, indices);
+
+        mesh.VertexCount = (GLuint)(mesh.Vertices.size() / FloatsPerVertex);
+        mesh.IndexCount = (GLuint)indices.size();
+        mesh.Bounds = computeBounds(mesh.Vertices);
+        if (mesh.VertexCount <= 0xFFFF)
+        {
+            mesh.IndexType = GL_UNSIGNED_SHORT;
+            mesh.Indices16.assign(indices.begin(), indices.end());
+        }
+        else
+        {
+            mesh.IndexType = GL_UNSIGNED_INT;
+            mesh.Indices32.swap(indices);
+        }
+        return mesh;
+    }
+
+private:
+    // axis-aligned box of the positions, and a sphere around the box center just large enough to hold every position
+    MeshBounds computeBounds(const std::vector<GLfloat>& vertices) const
+    {
+        MeshBounds bounds;
+        bounds.Min = bounds.Max = bounds.SphereCenter = glm::vec3(0.0f);
+        bounds.SphereRadius = 0.0f;
+        if (vertices.size() < FloatsPerVertex)
+            return bounds;
+
+        bounds.Min = bounds.Max = glm::vec3(vertices[0], vertices[1], vertices[2]);
+        for (size_t i = 0; i + 2 < vertices.size(); i += FloatsPerVertex)
+        {
+            glm::vec3 position(vertices[i], vertices[i + 1], vertices[i + 2]);
+            bounds.Min = glm::min(bounds.Min, position);
+            bounds.Max = glm::max(bounds.Max, position);
+        }
+
+        bounds.SphereCenter = (bounds.Min + bounds.Max) * 0.5f;
+        float radiusSquared = 0.0f;
+        for (size_t i = 0; i + 2 < vertices.size(); i += FloatsPerVertex)
+        {
+            glm::vec3 offset = glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]) - bounds.SphereCenter;
+            float distanceSquared = glm::dot(offset, offset);
+            if (distanceSquared > radiusSquared)
+                radiusSquared = distanceSquared;
+        }
+        bounds.SphereRadius = sqrtf(radiusSquared);
+        return bounds;
+    }
+
+    // hashes the raw bits of one vertex
+    size_t hashVertex(const GLfloat* vertex) const
+    {
+        size_t hash = 2166136261u;
+        const unsigned char* bytes = (const unsigned char*)vertex;
+        for (size_t i = 0; i < FloatsPerVertex * sizeof(GLfloat); ++i)
+            hash = (hash ^ bytes[i]) * 16777619u;
+        return hash;
+    }
+
+    // merges identical vertices using an open addressing table of output vertex indices
+    void weld(const GLfloat* vertices, GLuint vertexCount, std::vector<GLfloat>& outVertices, std::vector<GLuint>& outIndices) const
+    {
+        size_t tableSize = 1;
+        while (tableSize < vertexCount * 2)
+            tableSize <<= 1;
+        const GLuint empty = ~0u;
+        std::vector<GLuint> table(tableSize, empty);
+        const size_t vertexBytes = FloatsPerVertex * sizeof(GLfloat);
+
+        outVertices.clear();
+        outVertices.reserve(vertexCount * FloatsPerVertex);
+        outIndices.resize(vertexCount);
+
+        for (GLuint i = 0; i < vertexCount; ++i)
+        {
+            const GLfloat* vertex = vertices + i * FloatsPerVertex;
+            size_t slot = hashVertex(vertex) & (tableSize - 1);
+            while (table[slot] != empty && memcmp(&outVertices[table[slot] * FloatsPerVertex], vertex, vertexBytes) != 0)
+                slot = (slot + 1) & (tableSize - 1);
+
+            if (table[slot] == empty)
+            {
+                table[slot] = (GLuint)(outVertices.size() / FloatsPerVertex);
+                outVertices.insert(outVertices.end(), vertex, vertex + FloatsPerVertex);
+            }
+            outIndices[i] = table[slot];
+        }
+        outIndices.resize(vertexCount - vertexCount % 3);
+    }
+
+    // drops triangles that reference the same vertex twice, they never produce fragments
+    void removeDegenerates(std::vector<GLuint>& indices) const
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            GLuint a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            if (a == b || b == c || a == c)
+                continue;
+            indices[kept++] = a;
+            indices[kept++] = b;
+            indices[kept++] = c;
+        }
+        indices.resize(kept);
+    }
+
+    // score of a vertex given its position in the simulated cache (-1 when not cached) and its remaining triangles
+    float vertexScore(int cachePosition, unsigned remainingTriangles) const
+    {
+        if (remainingTriangles == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            // the three vertices of the last triangle get a fixed score so the next triangle doesn't just reuse them
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = powf(1.0f - (float)(cachePosition - 3) / (float)(CacheSize - 3), 1.5f);
+        }
+        // favour vertices with few triangles left so that lone triangles aren't left behind
+        score += 2.0f * powf((float)remainingTriangles, -0.5f);
+        return score;
+    }
+
+    // reorders the triangles to maximize hits in a post-transform cache of CacheSize entries
+    void optimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount) const
+    {
+        const size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        // triangles using each vertex, stored as one array with per-vertex offsets
+        std::vector<unsigned> remaining(vertexCount, 0);
+        for (size_t i = 0; i < indices.size(); ++i)
+            ++remaining[indices[i]];
+        std::vector<unsigned> adjacencyOffset(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; ++v)
+            adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+        std::vector<unsigned> adjacency(indices.size());
+        std::vector<unsigned> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i)
+            adjacency[fill[indices[i]]++] = (unsigned)(i / 3);
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> score(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v)
+            score[v] = vertexScore(-1, remaining[v]);
+
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<GLuint> cache, touched;
+        cache.reserve(CacheSize + 3);
+        std::vector<GLuint> output;
+        output.reserve(indices.size());
+
+        long best = -1;
+        float bestScore = -1.0f;
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            float s = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+            if (s > bestScore)
+            {
+                bestScore = s;
+                best = (long)t;
+            }
+        }
+
+        while (output.size() < indices.size())
+        {
+            // nothing left around the cache: restart from the best remaining triangle anywhere in the mesh
+            if (best < 0)
+            {
+                bestScore = -1.0f;
+                for (size_t t = 0; t < triangleCount; ++t)
+                {
+                    if (emitted[t])
+                        continue;
+                    float s = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                    if (s > bestScore)
+                    {
+                        bestScore = s;
+                        best = (long)t;
+                    }
+                }
+            }
+
+            emitted[best] = true;
+            for (int k = 0; k < 3; ++k)
+            {
+                GLuint v = indices[best * 3 + k];
+                output.push_back(v);
+
+                // unlink the triangle from the vertex
+                unsigned begin = adjacencyOffset[v];
+                unsigned end = begin + remaining[v];
+                for (unsigned a = begin; a < end; ++a)
+                {
+                    if (adjacency[a] == (unsigned)best)
+                    {
+                        adjacency[a] = adjacency[end - 1];
+                        break;
+                    }
+                }
+                --remaining[v];
+
+                // move the vertex to the front of the cache
+                for (size_t c = 0; c < cache.size(); ++c)
+                {
+                    if (cache[c] == v)
+                    {
+                        cache.erase(cache.begin() + c);
+                        break;
+                    }
+                }
+                cache.insert(cache.begin(), v);
+            }
+
+            // rescore everything that was in the cache, including the vertices that just fell out of it
+            touched = cache;
+            for (size_t c = 0; c < touched.size(); ++c)
+            {
+                GLuint v = touched[c];
+                cachePosition[v] = c < (size_t)CacheSize ? (int)c : -1;
+                score[v] = vertexScore(cachePosition[v], remaining[v]);
+            }
+            if (cache.size() > (size_t)CacheSize)
+                cache.resize(CacheSize);
+
+            // the next triangle is the best one touching the cache
+            best = -1;
+            bestScore = -1.0f;
+            for (size_t c = 0; c < touched.size(); ++c)
+            {
+                GLuint v = touched[c];
+                for (unsigned a = adjacencyOffset[v]; a < adjacencyOffset[v] + remaining[v]; ++a)
+                {
+                    unsigned t = adjacency[a];
+                    float s = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                    if (s > bestScore)
+                    {
+                        bestScore = s;
+                        best = (long)t;
+                    }
+                }
+            }
+        }
+        indices.swap(output);
+    }
+
+    // renumbers the vertices in the order the index buffer first references them
+    void optimizeVertexFetch(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices) const
+    {
+        const size_t vertexCount = vertices.size() / FloatsPerVertex;
+        const GLuint unused = ~0u;
+        std::vector<GLuint> remap(vertexCount, unused);
+        std::vector<GLfloat> reordered;
+        reordered.reserve(vertices.size());
+
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            GLuint v = indices[i];
+            if (remap[v] == unused)
+            {
+                remap[v] = (GLuint)(reordered.size() / FloatsPerVertex);
+                reordered.insert(reordered.end(), vertices.begin() + v * FloatsPerVertex, vertices.begin() + (v + 1) * FloatsPerVertex);
+            }
+            indices[i] = remap[v];
+        }
+        vertices.swap(reordered);
+    }
+};
+#endif
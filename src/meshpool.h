@@ -0,0 +1,384 @@
+#ifndef MESHPOOL_H
+#define MESHPOOL_H
+
+#include <GL/glew.h>
+
+#include <iostream>
+#include <vector>
+
+#include "meshbuilder.h"
+
+// Hands out sub-ranges [Offset, Offset + Count) of a linear arena. Free space is kept as a list of blocks sorted
+// by offset; neighbouring blocks are merged when a range is released
+class RangeAllocator
+{
+public:
+    RangeAllocator(GLuint capacity = 0) : mCapacity(0)
+    {
+        Grow(capacity);
+    }
+
+    // first-fit allocation. Returns false when no free block is large enough
+    bool Allocate(GLuint count, GLuint &offset)
+    {
+        for (size_t i = 0; i < mFree.size(); ++i)
+        {
+            if (mFree[i].Count < count)
+                continue;
+
+            offset = mFree[i].Offset;
+            mFree[i].Offset += count;
+            mFree[i].Count -= count;
+            if (mFree[i].Count == 0)
+                mFree.erase(mFree.begin() + i);
+            return true;
+        }
+        return false;
+    }
+
+    // returns a range to the free list
+    void Free(GLuint offset, GLuint count)
+    {
+        if (count == 0)
+            return;
+
+        size_t i = 0;
+        while (i < mFree.size() && mFree[i].Offset < offset)
+            ++i;
+        Block block = { offset, count };
+        mFree.insert(mFree.begin() + i, block);
+
+        // merge with the following block, then with the preceding one
+        if (i + 1 < mFree.size() && mFree[i].Offset + mFree[i].Count == mFree[i + 1].Offset)
+        {
+            mFree[i].Count += mFree[i + 1].Count;
+            mFree.erase(mFree.begin() + i + 1);
+        }
+        if (i > 0 && mFree[i - 1].Offset + mFree[i - 1].Count == mFree[i].Offset)
+        {
+            mFree[i - 1].Count += mFree[i].Count;
+            mFree.erase(mFree.begin() + i);
+        }
+    }
+
+    // extends the arena, the new space becomes free
+    void Grow(GLuint newCapacity)
+    {
+        if (newCapacity <= mCapacity)
+            return;
+        GLuint oldCapacity = mCapacity;
+        mCapacity = newCapacity;
+        Free(oldCapacity, newCapacity - oldCapacity);
+    }
+
+    // marks [0, used) as allocated and the rest of the arena as free, used after compaction
+    void Reset(GLuint used)
+    {
+        mFree.clear();
+        if (used < mCapacity)
+        {
+            Block block = { used, mCapacity - used };
+            mFree.push_back(block);
+        }
+    }
+
+    GLuint Capacity() const
+    {
+        return mCapacity;
+    }
+
+    // number of separate free blocks, more than one means the arena is fragmented
+    size_t FreeBlockCount() const
+    {
+        return mFree.size();
+    }
+
+private:
+    struct Block
+    {
+        GLuint Offset;
+        GLuint Count;
+    };
+
+    std::vector<Block> mFree;
+    GLuint mCapacity;
+};
+
+
+// Sub-allocation of one mesh inside the pool
+struct MeshRange
+{
+    GLint  BaseVertex;     // first vertex of the mesh in the shared vertex buffer
+    GLuint VertexCount;
+    GLuint FirstIndex;     // first index of the mesh in the shared index buffer
+    GLuint IndexCount;
+    MeshBounds Bounds;     // object-space bounds computed when the mesh was built
+    bool   Live;
+};
+
+typedef GLuint MeshHandle;
+
+// Packs the geometry of every mesh into one vertex buffer and one index buffer, drawn through one shared VAO with
+// the position/normal/UV layout. Indices stay local to their mesh and are rebased with glDrawElementsBaseVertex,
+// so ranges can be moved around during compaction without rewriting any index
+class MeshPool
+{
+public:
+    static const MeshHandle InvalidHandle = ~0u;
+
+    // interleaved position (3), normal (3) and texture coordinate (2)
+    static const GLuint FloatsPerVertex = 8;
+    static const GLsizei VertexStride = FloatsPerVertex * sizeof(GLfloat);
+
+    MeshPool() : mVao(0), mVbo(0), mEbo(0), mIndexType(GL_UNSIGNED_SHORT)
+    {
+    }
+
+    // creates the arena. The buffers grow on demand if the initial capacities turn out too small
+    void Create(GLuint vertexCapacity, GLuint indexCapacity, GLenum indexType = GL_UNSIGNED_SHORT)
+    {
+        mIndexType = indexType;
+        mVertexAllocator = RangeAllocator(vertexCapacity);
+        mIndexAllocator = RangeAllocator(indexCapacity);
+
+        glGenVertexArrays(1, &mVao);
+        mVbo = createBuffer((GLsizeiptr)vertexCapacity * VertexStride);
+        mEbo = createBuffer((GLsizeiptr)indexCapacity * IndexSize());
+
+        // position/normal/UV are described once and read from binding point 0
+        glBindVertexArray(mVao);
+        glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
+        glVertexAttribBinding(0, 0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat));
+        glVertexAttribBinding(1, 0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribFormat(2, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat));
+        glVertexAttribBinding(2, 0);
+        glEnableVertexAttribArray(2);
+        glBindVertexArray(0);
+        attachBuffers();
+    }
+
+    void Destroy()
+    {
+        glDeleteVertexArrays(1, &mVao);
+        glDeleteBuffers(1, &mVbo);
+        glDeleteBuffers(1, &mEbo);
+        mVao = mVbo = mEbo = 0;
+        mRanges.clear();
+        mFreeHandles.clear();
+    }
+
+    // copies indexed geometry into the arena and returns its handle, or InvalidHandle on failure
+    MeshHandle Upload(const IndexedMesh &mesh)
+    {
+        if (mesh.IndexType == GL_UNSIGNED_INT && mIndexType == GL_UNSIGNED_SHORT)
+        {
+            std::cout << "ERROR::MESHPOOL::UPLOAD mesh with " << mesh.VertexCount << " vertices needs 32-bit indices" << std::endl;
+            return InvalidHandle;
+        }
+
+        MeshRange range;
+        range.VertexCount = mesh.VertexCount;
+        range.IndexCount = mesh.IndexCount;
+        range.Bounds = mesh.Bounds;
+        range.Live = true;
+
+        GLuint baseVertex = 0;
+        if (!mVertexAllocator.Allocate(range.VertexCount, baseVertex))
+        {
+            growVertices(mVertexAllocator.Capacity() + range.VertexCount);
+            mVertexAllocator.Allocate(range.VertexCount, baseVertex);
+        }
+        if (!mIndexAllocator.Allocate(range.IndexCount, range.FirstIndex))
+        {
+            growIndices(mIndexAllocator.Capacity() + range.IndexCount);
+            mIndexAllocator.Allocate(range.IndexCount, range.FirstIndex);
+        }
+        range.BaseVertex = (GLint)baseVertex;
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mVbo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)baseVertex * VertexStride, mesh.Vertices.size() * sizeof(GLfloat), mesh.Vertices.data());
+
+        // widen 16-bit indices when the arena uses 32-bit ones
+        std::vector<GLuint> widened;
+        const void* indexData = mesh.IndexData();
+        if (mIndexType == GL_UNSIGNED_INT && mesh.IndexType == GL_UNSIGNED_SHORT)
+        {
+            widened.assign(mesh.Indices16.begin(), mesh.Indices16.end());
+            indexData = widened.data();
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mEbo);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)range.FirstIndex * IndexSize(), (GLsizeiptr)range.IndexCount * IndexSize(), indexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        MeshHandle handle;
+        if (!mFreeHandles.empty())
+        {
+            handle = mFreeHandles.back();
+            mFreeHandles.pop_back();
+            mRanges[handle] = range;
+        }
+        else
+        {
+            handle = (MeshHandle)mRanges.size();
+            mRanges.push_back(range);
+        }
+        return handle;
+    }
+
+    // releases the ranges of a mesh. The space is reused by later uploads, Compact() closes the holes
+    void Free(MeshHandle handle)
+    {
+        if (!IsValid(handle))
+            return;
+
+        MeshRange &range = mRanges[handle];
+        mVertexAllocator.Free((GLuint)range.BaseVertex, range.VertexCount);
+        mIndexAllocator.Free(range.FirstIndex, range.IndexCount);
+        range.Live = false;
+        mFreeHandles.push_back(handle);
+    }
+
+    // moves every live mesh to the front of the arena so that all the free space is one block at the end.
+    // Handles stay valid, only their offsets change
+    void Compact()
+    {
+        GLuint newVbo = createBuffer((GLsizeiptr)mVertexAllocator.Capacity() * VertexStride);
+        GLuint newEbo = createBuffer((GLsizeiptr)mIndexAllocator.Capacity() * IndexSize());
+        GLuint vertexTop = 0, indexTop = 0;
+
+        for (size_t i = 0; i < mRanges.size(); ++i)
+        {
+            MeshRange &range = mRanges[i];
+            if (!range.Live)
+                continue;
+
+            copyRange(mVbo, newVbo, (GLintptr)range.BaseVertex * VertexStride, (GLintptr)vertexTop * VertexStride, (GLsizeiptr)range.VertexCount * VertexStride);
+            copyRange(mEbo, newEbo, (GLintptr)range.FirstIndex * IndexSize(), (GLintptr)indexTop * IndexSize(), (GLsizeiptr)range.IndexCount * IndexSize());
+            range.BaseVertex = (GLint)vertexTop;
+            range.FirstIndex = indexTop;
+            vertexTop += range.VertexCount;
+            indexTop += range.IndexCount;
+        }
+
+        glDeleteBuffers(1, &mVbo);
+        glDeleteBuffers(1, &mEbo);
+        mVbo = newVbo;
+        mEbo = newEbo;
+        mVertexAllocator.Reset(vertexTop);
+        mIndexAllocator.Reset(indexTop);
+        attachBuffers();
+    }
+
+    bool IsValid(MeshHandle handle) const
+    {
+        return handle < mRanges.size() && mRanges[handle].Live;
+    }
+
+    const MeshRange& Range(MeshHandle handle) const
+    {
+        return mRanges[handle];
+    }
+
+    // byte offset of the first index of a mesh, as expected by the glDrawElements family
+    const void* IndexOffset(MeshHandle handle) const
+    {
+        return (const void*)((GLintptr)mRanges[handle].FirstIndex * IndexSize());
+    }
+
+    GLuint Vao() const
+    {
+        return mVao;
+    }
+
+    GLuint VertexBuffer() const
+    {
+        return mVbo;
+    }
+
+    GLuint IndexBuffer() const
+    {
+        return mEbo;
+    }
+
+    GLenum IndexType() const
+    {
+        return mIndexType;
+    }
+
+    GLuint IndexSize() const
+    {
+        return mIndexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    }
+
+private:
+    GLuint mVao;
+    GLuint mVbo;
+    GLuint mEbo;
+    GLenum mIndexType;
+    RangeAllocator mVertexAllocator;
+    RangeAllocator mIndexAllocator;
+    std::vector<MeshRange> mRanges;
+    std::vector<MeshHandle> mFreeHandles;
+
+    GLuint createBuffer(GLsizeiptr bytes)
+    {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return buffer;
+    }
+
+    void copyRange(GLuint source, GLuint destination, GLintptr sourceOffset, GLintptr destinationOffset, GLsizeiptr bytes)
+    {
+        if (bytes == 0)
+            return;
+        glBindBuffer(GL_COPY_READ_BUFFER, source);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sourceOffset, destinationOffset, bytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // reallocates a buffer with a larger size and copies the old contents over
+    GLuint resizeBuffer(GLuint buffer, GLsizeiptr oldBytes, GLsizeiptr newBytes)
+    {
+        GLuint resized = createBuffer(newBytes);
+        copyRange(buffer, resized, 0, 0, oldBytes);
+        glDeleteBuffers(1, &buffer);
+        return resized;
+    }
+
+    // capacities at least double so a stream of uploads stays amortized linear
+    void growVertices(GLuint minCapacity)
+    {
+        GLuint oldCapacity = mVertexAllocator.Capacity();
+        GLuint newCapacity = oldCapacity * 2 > minCapacity ? oldCapacity * 2 : minCapacity;
+        mVbo = resizeBuffer(mVbo, (GLsizeiptr)oldCapacity * VertexStride, (GLsizeiptr)newCapacity * VertexStride);
+        mVertexAllocator.Grow(newCapacity);
+        attachBuffers();
+    }
+
+    void growIndices(GLuint minCapacity)
+    {
+        GLuint oldCapacity = mIndexAllocator.Capacity();
+        GLuint newCapacity = oldCapacity * 2 > minCapacity ? oldCapacity * 2 : minCapacity;
+        mEbo = resizeBuffer(mEbo, (GLsizeiptr)oldCapacity * IndexSize(), (GLsizeiptr)newCapacity * IndexSize());
+        mIndexAllocator.Grow(newCapacity);
+        attachBuffers();
+    }
+
+    // points the shared VAO at the current buffers
+    void attachBuffers()
+    {
+        glBindVertexArray(mVao);
+        glBindVertexBuffer(0, mVbo, 0, VertexStride);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEbo);
+        glBindVertexArray(0);
+    }
+};
+#endif
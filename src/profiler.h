@@ -0,0 +1,376 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Measures where a frame's time goes. Every frame is a tree of named scopes timed on the CPU with a steady clock and
+// on the GPU with a GL_TIMESTAMP query at each end (GL_TIME_ELAPSED queries can't nest). Queries are double
+// buffered: a frame's results are read when its query set comes round again two frames later, and a frame whose
+// queries still aren't done then keeps its CPU times only, so reading results never stalls. Finished frames go into
+// a ring of the most recent frames that can be summarized with percentiles or written as a Chrome trace
+// (chrome://tracing, Perfetto)
+class FrameProfiler
+{
+public:
+    static const unsigned MaxScopes = 64;   // per frame, deeper instrumentation is dropped
+    static const unsigned QuerySets = 2;
+
+    FrameProfiler() : mEnabled(false), mFrame(0), mHistoryHead(0), mHistoryCount(0), mGpuOffset(0.0), mCurrent(NULL)
+    {
+    }
+
+    // keeps the last historyFrames frames, at least one. Needs a current context
+    void Create(unsigned historyFrames = 600)
+    {
+        if (historyFrames < 1)
+            historyFrames = 1;
+        mEnabled = true;
+        mStart = std::chrono::steady_clock::now();
+        mHistory.assign(historyFrames, FrameRecord());
+        mHistoryHead = mHistoryCount = 0;
+        for (unsigned i = 0; i < QuerySets; ++i)
+        {
+            glGenQueries(2 * MaxScopes, mSets[i].Queries);
+            mSets[i].Pending = false;
+        }
+
+        // GPU timestamps are placed on the CPU timeline by the offset between both clocks now
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        mGpuOffset = now() - gpuNow / 1000.0;
+    }
+
+    void Destroy()
+    {
+        if (!mEnabled)
+            return;
+        for (unsigned i = 0; i < QuerySets; ++i)
+            glDeleteQueries(2 * MaxScopes, mSets[i].Queries);
+        mEnabled = false;
+    }
+
+    bool Enabled() const
+    {
+        return mEnabled;
+    }
+
+    // opens the frame scope. Resolves the frame that last used this frame's query set
+    void BeginFrame()
+    {
+        if (!mEnabled)
+            return;
+        QuerySet &set = mSets[mFrame % QuerySets];
+        if (set.Pending)
+            resolve(set);
+        set.Pending = true;
+        mCurrent = &set.Frame;
+        mCurrent->Index = mFrame;
+        mCurrent->Scopes.clear();
+        mStack.clear();
+        Begin("frame");
+    }
+
+    void EndFrame()
+    {
+        if (!mEnabled || !mCurrent)
+            return;
+        while (!mStack.empty())
+            End();
+        mCurrent = NULL;
+        ++mFrame;
+    }
+
+    // scopes nest and must be closed in reverse order, within the frame that opened them. Scopes outside a frame,
+    // such as loading before the first one, aren't recorded
+    void Begin(const char* name)
+    {
+        if (!mEnabled || !mCurrent)
+            return;
+        if (mCurrent->Scopes.size() >= MaxScopes)
+        {
+            mStack.push_back(-1);
+            return;
+        }
+        Scope scope;
+        scope.Name = name;
+        scope.Depth = (int)mStack.size();
+        scope.CpuBegin = now();
+        scope.CpuEnd = scope.CpuBegin;
+        scope.GpuBegin = scope.GpuEnd = -1.0;
+        mStack.push_back((int)mCurrent->Scopes.size());
+        glQueryCounter(mSets[mFrame % QuerySets].Queries[2 * mCurrent->Scopes.size()], GL_TIMESTAMP);
+        mCurrent->Scopes.push_back(scope);
+    }
+
+    void End()
+    {
+        if (!mEnabled || !mCurrent || mStack.empty())
+            return;
+        int index = mStack.back();
+        mStack.pop_back();
+        if (index < 0)
+            return;
+        mCurrent->Scopes[index].CpuEnd = now();
+        glQueryCounter(mSets[mFrame % QuerySets].Queries[2 * index + 1], GL_TIMESTAMP);
+    }
+
+    // waits for the GPU and moves the frames still waiting for their queries into the history, oldest first
+    void Flush()
+    {
+        if (!mEnabled)
+            return;
+        glFinish();
+        for (unsigned i = 0; i < QuerySets; ++i)
+        {
+            QuerySet &set = mSets[(mFrame + i) % QuerySets];
+            if (set.Pending)
+                resolve(set);
+        }
+    }
+
+    // frames begun so far
+    unsigned FrameIndex() const
+    {
+        return mFrame;
+    }
+
+    // frames in the history
+    unsigned Frames() const
+    {
+        return mHistoryCount;
+    }
+
+    // CPU and GPU time of every frame in the history, oldest first, in microseconds. Frames whose GPU time is
+    // unknown are left out of gpuTimes
+    void FrameTimes(std::vector<double> &cpuTimes, std::vector<double> &gpuTimes) const
+    {
+        cpuTimes.clear();
+        gpuTimes.clear();
+        for (unsigned i = 0; i < mHistoryCount; ++i)
+        {
+            const FrameRecord &frame = mHistory[(mHistoryHead + mHistory.size() - mHistoryCount + i) % mHistory.size()];
+            if (frame.Scopes.empty())
+                continue;
+            const Scope &scope = frame.Scopes[0];
+            cpuTimes.push_back(scope.CpuEnd - scope.CpuBegin);
+            if (scope.GpuBegin >= 0.0)
+                gpuTimes.push_back(scope.GpuEnd - scope.GpuBegin);
+        }
+    }
+
+    // nearest rank percentile of sorted, non empty times, fraction in [0, 1]
+    static double Percentile(const std::vector<double> &sorted, double fraction)
+    {
+        size_t rank = (size_t)std::ceil(fraction * sorted.size());
+        return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+    }
+
+    // frame time percentiles over the history and the average time of every scope, in milliseconds
+    void Summary(std::ostream &out) const
+    {
+        std::vector<double> cpuFrames, gpuFrames;
+        std::vector<ScopeTotal> totals;
+        for (unsigned i = 0; i < mHistoryCount; ++i)
+        {
+            const FrameRecord &frame = mHistory[i];
+            for (size_t s = 0; s < frame.Scopes.size(); ++s)
+            {
+                const Scope &scope = frame.Scopes[s];
+                double cpu = scope.CpuEnd - scope.CpuBegin;
+                double gpu = scope.GpuBegin >= 0.0 ? scope.GpuEnd - scope.GpuBegin : -1.0;
+                if (s == 0)
+                {
+                    cpuFrames.push_back(cpu);
+                    if (gpu >= 0.0)
+                        gpuFrames.push_back(gpu);
+                }
+                ScopeTotal &total = totalFor(totals, scope);
+                total.Cpu += cpu;
+                ++total.CpuCount;
+                if (gpu >= 0.0)
+                {
+                    total.Gpu += gpu;
+                    ++total.GpuCount;
+                }
+            }
+        }
+
+        out << "INFO: frame profile over the last " << mHistoryCount << " frames (ms)" << std::endl;
+        printPercentiles(out, "frame cpu", cpuFrames);
+        printPercentiles(out, "frame gpu", gpuFrames);
+        for (size_t i = 0; i < totals.size(); ++i)
+        {
+            char line[160];
+            snprintf(line, sizeof(line), "    %*s%-*s cpu %8.3f  gpu %8.3f", 2 * totals[i].Depth, "", 24 - 2 * totals[i].Depth, totals[i].Name,
+                totals[i].Cpu / totals[i].CpuCount / 1000.0, totals[i].GpuCount ? totals[i].Gpu / totals[i].GpuCount / 1000.0 : 0.0);
+            out << line << std::endl;
+        }
+    }
+
+    // writes the history in the Chrome trace event format, CPU scopes on one track and GPU scopes on another
+    bool WriteChromeTrace(const std::string &filename) const
+    {
+        FILE* file = fopen(filename.c_str(), "w");
+        if (!file)
+        {
+            std::cout << "ERROR::PROFILER::WRITE_FAILED " << filename << std::endl;
+            return false;
+        }
+        fprintf(file, "{\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+        for (unsigned i = 0; i < mHistoryCount; ++i)
+        {
+            const FrameRecord &frame = mHistory[(mHistoryHead + mHistory.size() - mHistoryCount + i) % mHistory.size()];
+            for (size_t s = 0; s < frame.Scopes.size(); ++s)
+            {
+                const Scope &scope = frame.Scopes[s];
+                fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+                    scope.Name, scope.CpuBegin, scope.CpuEnd - scope.CpuBegin, frame.Index);
+                if (scope.GpuBegin >= 0.0)
+                    fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+                        scope.Name, scope.GpuBegin + mGpuOffset, scope.GpuEnd - scope.GpuBegin, frame.Index);
+            }
+        }
+        fprintf(file, "\n]}\n");
+        bool written = !ferror(file);
+        written = fclose(file) == 0 && written;
+        if (!written)
+            std::cout << "ERROR::PROFILER::WRITE_FAILED " << filename << std::endl;
+        return written;
+    }
+
+private:
+    // times in microseconds, CPU ones since Create and GPU ones on the GPU clock, -1 when unavailable
+    struct Scope
+    {
+        const char* Name;   // string literal, scopes are matched by name
+        int Depth;
+        double CpuBegin;
+        double CpuEnd;
+        double GpuBegin;
+        double GpuEnd;
+    };
+
+    struct FrameRecord
+    {
+        unsigned Index;
+        std::vector<Scope> Scopes;   // in the order they were opened, the frame scope first
+    };
+
+    struct QuerySet
+    {
+        GLuint Queries[2 * MaxScopes];   // begin and end timestamp of every scope
+        FrameRecord Frame;
+        bool Pending;                    // holds a frame that hasn't been resolved yet
+    };
+
+    struct ScopeTotal
+    {
+        const char* Name;
+        int Depth;
+        double Cpu;
+        double Gpu;
+        unsigned CpuCount;
+        unsigned GpuCount;
+    };
+
+    bool mEnabled;
+    std::chrono::steady_clock::time_point mStart;
+    unsigned mFrame;
+    QuerySet mSets[QuerySets];
+    std::vector<FrameRecord> mHistory;
+    unsigned mHistoryHead;    // slot the next finished frame goes to
+    unsigned mHistoryCount;
+    double mGpuOffset;
+    FrameRecord* mCurrent;    // frame between BeginFrame and EndFrame, NULL outside one
+    std::vector<int> mStack;  // open scopes, -1 for dropped ones
+
+    double now() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - mStart).count();
+    }
+
+    // reads the GPU times of a finished frame when they are ready and moves it into the history
+    void resolve(QuerySet &set)
+    {
+        FrameRecord &frame = set.Frame;
+        GLint available = 0;
+        if (!frame.Scopes.empty())
+            // the frame scope closes last, so once its end is available every other query is too
+            glGetQueryObjectiv(set.Queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            for (size_t s = 0; s < frame.Scopes.size(); ++s)
+            {
+                GLuint64 begin = 0, end = 0;
+                glGetQueryObjectui64v(set.Queries[2 * s], GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(set.Queries[2 * s + 1], GL_QUERY_RESULT, &end);
+                frame.Scopes[s].GpuBegin = begin / 1000.0;
+                frame.Scopes[s].GpuEnd = end / 1000.0;
+            }
+        }
+
+        // swapped rather than copied so both vectors keep their capacity
+        mHistory[mHistoryHead].Index = frame.Index;
+        mHistory[mHistoryHead].Scopes.swap(frame.Scopes);
+        mHistoryHead = (mHistoryHead + 1) % (unsigned)mHistory.size();
+        if (mHistoryCount < mHistory.size())
+            ++mHistoryCount;
+        set.Pending = false;
+    }
+
+    static ScopeTotal& totalFor(std::vector<ScopeTotal> &totals, const Scope &scope)
+    {
+        for (size_t i = 0; i < totals.size(); ++i)
+            if (totals[i].Depth == scope.Depth && std::string(totals[i].Name) == scope.Name)
+                return totals[i];
+        ScopeTotal total = { scope.Name, scope.Depth, 0.0, 0.0, 0, 0 };
+        totals.push_back(total);
+        return totals.back();
+    }
+
+    static void printPercentiles(std::ostream &out, const char* label, std::vector<double> &times)
+    {
+        if (times.empty())
+        {
+            out << "    " << label << ": no samples" << std::endl;
+            return;
+        }
+        std::sort(times.begin(), times.end());
+        char line[128];
+        snprintf(line, sizeof(line), "    %s: p50 %.3f  p95 %.3f  p99 %.3f  max %.3f", label, Percentile(times, 0.50) / 1000.0,
+            Percentile(times, 0.95) / 1000.0, Percentile(times, 0.99) / 1000.0, times.back() / 1000.0);
+        out << line << std::endl;
+    }
+};
+
+// Times the enclosing block as a scope of the current frame
+class ProfileScope
+{
+public:
+    ProfileScope(FrameProfiler &profiler, const char* name) : mProfiler(profiler)
+    {
+        mProfiler.Begin(name);
+    }
+
+    ~ProfileScope()
+    {
+        mProfiler.End();
+    }
+
+private:
+    FrameProfiler &mProfiler;
+
+    ProfileScope(const ProfileScope&);
+    ProfileScope& operator=(const ProfileScope&);
+};
+#endif
@@ -0,0 +1,202 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Keeps linked programs on disk as driver binaries so later runs skip compiling and linking. A binary is found by
+// hashing the shader sources together with the GL vendor, renderer and version, so editing a shader or changing
+// driver misses the cache and the program is compiled from source again. Programs must be linked with
+// GL_PROGRAM_BINARY_RETRIEVABLE_HINT set for Store to work. Once created, Load and Store may be called from any
+// thread with a current context sharing objects with the one that created the cache
+class ProgramCache
+{
+public:
+    ProgramCache() : mEnabled(false), mHits(0), mMisses(0)
+    {
+    }
+
+    // binaries are kept in directory, which is created when missing. Needs a current context
+    void Create(const std::string &directory)
+    {
+        mDirectory = directory;
+        mDriver = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION);
+
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        mEnabled = formats > 0;
+        if (!mEnabled)
+        {
+            std::cout << "INFO: the driver offers no program binary formats, shaders are compiled on every run" << std::endl;
+            return;
+        }
+#ifdef _WIN32
+        _mkdir(mDirectory.c_str());
+#else
+        mkdir(mDirectory.c_str(), 0755);
+#endif
+    }
+
+    // returns a linked program built from the cached binary of these sources, or 0 when there is none or the
+    // driver rejects it
+    GLuint Load(const char* vertexSource, const char* fragmentSource)
+    {
+        if (!mEnabled)
+            return 0;
+
+        uint64_t key = hash(vertexSource, fragmentSource);
+        FILE* file = fopen(path(key).c_str(), "rb");
+        if (!file)
+        {
+            ++mMisses;
+            return 0;
+        }
+
+        // the driver identity is stored in full so a hash collision can't hand one driver another's binary
+        Header header;
+        std::string driver;
+        std::vector<char> binary;
+        bool valid = fread(&header, sizeof(header), 1, file) == 1 && header.Magic == Magic && header.Key == key;
+        if (valid)
+        {
+            driver.resize(header.DriverLength);
+            binary.resize(header.BinaryLength);
+            valid = fread(&driver[0], 1, driver.size(), file) == driver.size() && driver == mDriver &&
+                fread(binary.data(), 1, binary.size(), file) == binary.size();
+        }
+        fclose(file);
+        if (!valid || binary.empty())
+        {
+            ++mMisses;
+            return 0;
+        }
+
+        GLuint programId = glCreateProgram();
+        glProgramBinary(programId, header.Format, binary.data(), (GLsizei)binary.size());
+        GLint success = 0;
+        glGetProgramiv(programId, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            // usually a driver update that kept its version string, the next Store replaces the file
+            glDeleteProgram(programId);
+            ++mMisses;
+            return 0;
+        }
+        ++mHits;
+        return programId;
+    }
+
+    // writes the binary of a program linked from these sources. Returns false when it couldn't be saved
+    bool Store(GLuint programId, const char* vertexSource, const char* fragmentSource)
+    {
+        if (!mEnabled)
+            return false;
+
+        GLint length = 0;
+        glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return false;
+        std::vector<char> binary((size_t)length);
+        Header header;
+        header.Magic = Magic;
+        header.Key = hash(vertexSource, fragmentSource);
+        header.Format = 0;
+        glGetProgramBinary(programId, length, &length, &header.Format, binary.data());
+        header.DriverLength = (uint32_t)mDriver.size();
+        header.BinaryLength = (uint32_t)length;
+
+        // written under a temporary name and renamed, so another run never reads half a file
+        std::string filename = path(header.Key);
+        std::string temporary = filename + ".tmp";
+        FILE* file = fopen(temporary.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "ERROR::PROGRAMCACHE::WRITE_FAILED " << temporary << std::endl;
+            return false;
+        }
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(mDriver.data(), 1, mDriver.size(), file) == mDriver.size() &&
+            fwrite(binary.data(), 1, (size_t)length, file) == (size_t)length;
+        written = fclose(file) == 0 && written;
+        std::remove(filename.c_str());
+        if (!written || std::rename(temporary.c_str(), filename.c_str()) != 0)
+        {
+            std::remove(temporary.c_str());
+            std::cout << "ERROR::PROGRAMCACHE::WRITE_FAILED " << filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // programs loaded from binaries and programs that had to be compiled
+    unsigned Hits() const
+    {
+        return mHits;
+    }
+
+    unsigned Misses() const
+    {
+        return mMisses;
+    }
+
+private:
+    static const uint32_t Magic = 0x42504C47;   // "GLPB"
+
+    struct Header
+    {
+        uint32_t Magic;
+        GLenum   Format;
+        uint64_t Key;
+        uint32_t DriverLength;
+        uint32_t BinaryLength;
+    };
+
+    bool mEnabled;
+    std::atomic<unsigned> mHits;
+    std::atomic<unsigned> mMisses;
+    std::string mDirectory;
+    std::string mDriver;   // vendor, renderer and version, one per line
+
+    static std::string glString(GLenum name)
+    {
+        const GLubyte* text = glGetString(name);
+        return text ? std::string((const char*)text) : std::string();
+    }
+
+    // 64 bit FNV-1a over both sources and the driver identity, each followed by a 0 so their boundaries count
+    uint64_t hash(const char* vertexSource, const char* fragmentSource) const
+    {
+        uint64_t value = 14695981039346656037ull;
+        const char* parts[3] = { vertexSource, fragmentSource, mDriver.c_str() };
+        for (int part = 0; part < 3; ++part)
+        {
+            const char* text = parts[part];
+            do
+            {
+                value ^= (unsigned char)*text;
+                value *= 1099511628211ull;
+            } while (*text++);
+        }
+        return value;
+    }
+
+    std::string path(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return mDirectory + "/" + name;
+    }
+};
+#endif
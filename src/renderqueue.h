@@ -0,0 +1,117 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Passes in submission order
+enum RenderPass {
+    PASS_OPAQUE,
+    PASS_TRANSPARENT,
+    PASS_OVERLAY
+};
+
+// One draw waiting in the queue: a packed sort key and the scene node it draws
+struct RenderItem
+{
+    uint64_t Key;
+    uint32_t Node;
+};
+
+// Collects the draws of a frame and orders them by a 64-bit key packing, from most to least significant,
+//   pass (2 bits) | program (8) | material (12) | mesh (16) | depth (24)
+// so that sorting groups draws by state first and, within identical state, orders opaque geometry front to back
+// for early-Z and transparent geometry back to front. Sorting is an LSD radix sort over the key bytes
+class RenderQueue
+{
+public:
+    static const int PassBits = 2;
+    static const int ProgramBits = 8;
+    static const int MaterialBits = 12;
+    static const int MeshBits = 16;
+    static const int DepthBits = 24;
+
+    std::vector<RenderItem> Items;
+
+    // packs a sort key. depth is the normalized view distance in [0, 1]
+    static uint64_t MakeKey(RenderPass pass, uint32_t program, uint32_t material, uint32_t mesh, float depth)
+    {
+        if (depth < 0.0f)
+            depth = 0.0f;
+        if (depth > 1.0f)
+            depth = 1.0f;
+        uint64_t depthBits = (uint64_t)(depth * (float)((1u << DepthBits) - 1));
+        // transparent draws blend back to front, so their depth field counts down
+        if (pass == PASS_TRANSPARENT)
+            depthBits = ((1u << DepthBits) - 1) - depthBits;
+
+        uint64_t key = (uint64_t)pass & ((1u << PassBits) - 1);
+        key = (key << ProgramBits) | (program & ((1u << ProgramBits) - 1));
+        key = (key << MaterialBits) | (material & ((1u << MaterialBits) - 1));
+        key = (key << MeshBits) | (mesh & ((1u << MeshBits) - 1));
+        key = (key << DepthBits) | depthBits;
+        return key;
+    }
+
+    void Clear()
+    {
+        Items.clear();
+    }
+
+    void Push(uint64_t key, uint32_t node)
+    {
+        RenderItem item = { key, node };
+        Items.push_back(item);
+    }
+
+    // sorts the items by key. The sort is stable, and byte positions where every key agrees are skipped
+    void Sort()
+    {
+        const size_t count = Items.size();
+        if (count < 2)
+            return;
+
+        // histograms of all eight bytes gathered in a single pass over the keys
+        size_t histogram[8][256] = {};
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint64_t key = Items[i].Key;
+            for (int b = 0; b < 8; ++b)
+                ++histogram[b][(key >> (b * 8)) & 0xFF];
+        }
+
+        mScratch.resize(count);
+        RenderItem* source = Items.data();
+        RenderItem* destination = mScratch.data();
+        for (int b = 0; b < 8; ++b)
+        {
+            size_t* counts = histogram[b];
+            // every key has the same value in this byte, the pass wouldn't move anything
+            if (counts[(source[0].Key >> (b * 8)) & 0xFF] == count)
+                continue;
+
+            size_t offset = 0;
+            for (int v = 0; v < 256; ++v)
+            {
+                size_t bucket = counts[v];
+                counts[v] = offset;
+                offset += bucket;
+            }
+            for (size_t i = 0; i < count; ++i)
+                destination[counts[(source[i].Key >> (b * 8)) & 0xFF]++] = source[i];
+
+            RenderItem* swap = source;
+            source = destination;
+            destination = swap;
+        }
+
+        // an odd number of passes left the result in the scratch buffer
+        if (source != Items.data())
+            Items.swap(mScratch);
+    }
+
+private:
+    std::vector<RenderItem> mScratch;
+};
+#endif
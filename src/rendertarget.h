@@ -0,0 +1,76 @@
+#ifndef RENDERTARGET_H
+#define RENDERTARGET_H
+
+#include <GL/glew.h>
+
+#include <iostream>
+
+// An offscreen framebuffer with an RGBA8 color and a 24 bit depth renderbuffer, for rendering without a window
+class RenderTarget
+{
+public:
+    RenderTarget() : mFramebuffer(0), mColor(0), mDepth(0), mWidth(0), mHeight(0)
+    {
+    }
+
+    bool Create(GLsizei width, GLsizei height)
+    {
+        mWidth = width;
+        mHeight = height;
+        glGenRenderbuffers(1, &mColor);
+        glBindRenderbuffer(GL_RENDERBUFFER, mColor);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &mDepth);
+        glBindRenderbuffer(GL_RENDERBUFFER, mDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &mFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColor);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepth);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete)
+            std::cout << "ERROR::RENDERTARGET::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        return complete;
+    }
+
+    void Destroy()
+    {
+        glDeleteFramebuffers(1, &mFramebuffer);
+        glDeleteRenderbuffers(1, &mColor);
+        glDeleteRenderbuffers(1, &mDepth);
+        mFramebuffer = mColor = mDepth = 0;
+    }
+
+    // makes the target the destination of the following draws
+    void Bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+        glViewport(0, 0, mWidth, mHeight);
+    }
+
+    GLuint Framebuffer() const
+    {
+        return mFramebuffer;
+    }
+
+    GLsizei Width() const
+    {
+        return mWidth;
+    }
+
+    GLsizei Height() const
+    {
+        return mHeight;
+    }
+
+private:
+    GLuint mFramebuffer;
+    GLuint mColor;
+    GLuint mDepth;
+    GLsizei mWidth;
+    GLsizei mHeight;
+};
+#endif
@@ -0,0 +1,97 @@
+#ifndef SAMPLERS_H
+#define SAMPLERS_H
+
+#include <GL/glew.h>
+
+#include <iostream>
+
+#include "glstate.h"
+
+// Wrap modes of the shared samplers. Materials store one of these, the values are read by the fragment shader
+enum SamplerWrap {
+    SAMPLER_REPEAT,
+    SAMPLER_MIRRORED_REPEAT,
+    SAMPLER_CLAMP,
+    SAMPLER_COUNT
+};
+
+// maps a GL wrap mode such as GL_REPEAT onto its sampler, unknown modes repeat
+inline SamplerWrap SamplerWrapFor(GLenum wrapMode)
+{
+    switch (wrapMode)
+    {
+        case GL_MIRRORED_REPEAT:
+            return SAMPLER_MIRRORED_REPEAT;
+        case GL_CLAMP_TO_EDGE:
+        case GL_CLAMP_TO_BORDER:
+            return SAMPLER_CLAMP;
+        default:
+            return SAMPLER_REPEAT;
+    }
+}
+
+// Sampler objects shared by every texture, one per wrap mode. Filtering and wrapping live here instead of on the
+// texture objects, so a texture can be sampled differently by different materials. All of them filter
+// trilinearly through the mip chain and anisotropically when the driver supports it
+class SamplerSet
+{
+public:
+    SamplerSet() : mAnisotropy(1.0f)
+    {
+        for (int i = 0; i < SAMPLER_COUNT; ++i)
+            mSamplers[i] = 0;
+    }
+
+    // creates the samplers. anisotropy is the maximum number of samples taken along the footprint, it is clamped
+    // to what the driver allows and 1 turns anisotropic filtering off
+    void Create(float anisotropy)
+    {
+        static const GLenum wrapModes[SAMPLER_COUNT] = { GL_REPEAT, GL_MIRRORED_REPEAT, GL_CLAMP_TO_EDGE };
+
+        mAnisotropy = 1.0f;
+        if (anisotropy > 1.0f && (GLEW_ARB_texture_filter_anisotropic || GLEW_EXT_texture_filter_anisotropic))
+        {
+            GLfloat maxAnisotropy = 1.0f;
+            glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+            mAnisotropy = anisotropy < maxAnisotropy ? anisotropy : maxAnisotropy;
+        }
+        else if (anisotropy > 1.0f)
+            std::cout << "ERROR::SAMPLERS::ANISOTROPIC_FILTERING_UNSUPPORTED, using trilinear filtering" << std::endl;
+
+        glGenSamplers(SAMPLER_COUNT, mSamplers);
+        for (int i = 0; i < SAMPLER_COUNT; ++i)
+        {
+            // set the texture wrapping parameters
+            glSamplerParameteri(mSamplers[i], GL_TEXTURE_WRAP_S, wrapModes[i]);
+            glSamplerParameteri(mSamplers[i], GL_TEXTURE_WRAP_T, wrapModes[i]);
+            // set texture filtering parameters
+            glSamplerParameteri(mSamplers[i], GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glSamplerParameteri(mSamplers[i], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            if (mAnisotropy > 1.0f)
+                glSamplerParameterf(mSamplers[i], GL_TEXTURE_MAX_ANISOTROPY_EXT, mAnisotropy);
+        }
+    }
+
+    void Destroy()
+    {
+        glDeleteSamplers(SAMPLER_COUNT, mSamplers);
+        for (int i = 0; i < SAMPLER_COUNT; ++i)
+            mSamplers[i] = 0;
+    }
+
+    GLuint Get(SamplerWrap wrap) const
+    {
+        return mSamplers[wrap];
+    }
+
+    // anisotropy actually used, after clamping
+    float Anisotropy() const
+    {
+        return mAnisotropy;
+    }
+
+private:
+    GLuint mSamplers[SAMPLER_COUNT];
+    float mAnisotropy;
+};
+#endif
@@ -0,0 +1,235 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <vector>
+
+#include "frustum.h"
+#include "meshbuilder.h"
+
+// Describes how the surface of a node is shaded. Nodes refer to materials by index so that many nodes can share one
+struct Material
+{
+    GLuint TextureId;   // 0 for an untextured material
+    GLenum WrapMode;    // GL_REPEAT, GL_MIRRORED_REPEAT or GL_CLAMP_TO_EDGE
+    glm::vec4 Color;    // multiplied with the texture, or used alone without one
+    // Phong strengths, a specular intensity of 0 lets the material use a variant without highlights
+    float AmbientStrength;
+    float SpecularIntensity;
+    float HighlightSize;
+};
+
+// A single drawable object in the scene
+struct SceneNode
+{
+    // local transform, composed as translation * rotation * scale
+    glm::vec3 Translation;
+    glm::vec3 RotationAxis;
+    float     RotationAngle;
+    glm::vec3 Scale;
+    // world transform cached from the last call to Scene::UpdateWorldMatrices
+    glm::mat4 World;
+    // inverse transpose of the upper 3x3 of World, used to bring normals into world space
+    glm::mat3 Normal;
+    // true when World is a rotation and translation with the same scale on every axis
+    bool      UniformScale;
+    // bounding sphere of the mesh carried into world space
+    glm::vec3 WorldCenter;
+    float     WorldRadius;
+    // index of the parent node, or -1 for a root node
+    int       Parent;
+    // mesh handle and index into Scene::Materials
+    GLuint    Mesh;
+    GLuint    Material;
+    // set when the local transform changed and World has to be rebuilt
+    bool      Dirty;
+    // update stamp of the last time World was rebuilt
+    unsigned  Version;
+};
+
+// A flat scene graph. Nodes live in one contiguous array with every parent stored before its children,
+// so world matrices can be brought up to date in a single linear pass without recursion
+class Scene
+{
+public:
+    std::vector<Material>  Materials;
+    std::vector<SceneNode> Nodes;
+    // world-space box of every node, same order as Nodes, kept up to date by UpdateWorldMatrices
+    BoundsList WorldBounds;
+
+    Scene() : mDirtyCount(0), mUpdateStamp(0)
+    {
+    }
+
+    // adds a material and returns its index
+    GLuint AddMaterial(GLuint textureId, GLenum wrapMode = GL_REPEAT)
+    {
+        Material material;
+        material.TextureId = textureId;
+        material.WrapMode = wrapMode;
+        material.Color = glm::vec4(1.0f);
+        material.AmbientStrength = 0.2f;
+        material.SpecularIntensity = 0.2f;
+        material.HighlightSize = 16.0f;
+        Materials.push_back(material);
+        return (GLuint)(Materials.size() - 1);
+    }
+
+    // adds a node and returns its index. The parent, if any, must already have been added
+    int AddNode(GLuint mesh, GLuint material, glm::vec3 translation, float rotationAngle = 0.0f, glm::vec3 rotationAxis = glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3 scale = glm::vec3(1.0f), int parent = -1)
+    {
+        SceneNode node;
+        node.Translation = translation;
+        node.RotationAxis = rotationAxis;
+        node.RotationAngle = rotationAngle;
+        node.Scale = scale;
+        node.World = glm::mat4(1.0f);
+        node.Normal = glm::mat3(1.0f);
+        node.UniformScale = true;
+        node.WorldCenter = translation;
+        node.WorldRadius = 0.0f;
+        node.Parent = parent < (int)Nodes.size() ? parent : -1;
+        node.Mesh = mesh;
+        node.Material = material;
+        node.Dirty = true;
+        node.Version = 0;
+        Nodes.push_back(node);
+        WorldBounds.Resize(Nodes.size());
+        ++mDirtyCount;
+        return (int)(Nodes.size() - 1);
+    }
+
+    // records the object-space bounds of a mesh. Nodes drawing it get their world bounds rebuilt
+    void SetMeshBounds(GLuint mesh, const MeshBounds &bounds)
+    {
+        if (mesh >= mMeshBounds.size())
+        {
+            mMeshBounds.resize(mesh + 1);
+            mHasMeshBounds.resize(mesh + 1, false);
+        }
+        mMeshBounds[mesh] = bounds;
+        mHasMeshBounds[mesh] = true;
+        for (size_t i = 0; i < Nodes.size(); ++i)
+            if (Nodes[i].Mesh == mesh)
+                markDirty((int)i);
+    }
+
+    // setters for the local transform. They only flag the node, the matrices are rebuilt by UpdateWorldMatrices
+    void SetTranslation(int node, glm::vec3 translation)
+    {
+        Nodes[node].Translation = translation;
+        markDirty(node);
+    }
+
+    void SetRotation(int node, float angle, glm::vec3 axis)
+    {
+        Nodes[node].RotationAngle = angle;
+        Nodes[node].RotationAxis = axis;
+        markDirty(node);
+    }
+
+    void SetScale(int node, glm::vec3 scale)
+    {
+        Nodes[node].Scale = scale;
+        markDirty(node);
+    }
+
+    // rebuilds the world and normal matrices and the world bounds of every dirty node and of every node below a
+    // dirty parent. Returns the number of nodes that were rebuilt
+    unsigned UpdateWorldMatrices()
+    {
+        if (mDirtyCount == 0)
+            return 0;
+
+        ++mUpdateStamp;
+        unsigned rebuilt = 0;
+        for (size_t i = 0; i < Nodes.size(); ++i)
+        {
+            SceneNode& node = Nodes[i];
+            bool parentChanged = node.Parent >= 0 && Nodes[node.Parent].Version == mUpdateStamp;
+            if (!node.Dirty && !parentChanged)
+                continue;
+
+            glm::mat4 translation = glm::translate(node.Translation);
+            glm::mat4 rotation = glm::rotate(node.RotationAngle, node.RotationAxis);
+            glm::mat4 scale = glm::scale(node.Scale);
+            node.World = translation * rotation * scale;
+            node.UniformScale = node.Scale.x == node.Scale.y && node.Scale.y == node.Scale.z;
+            if (node.Parent >= 0)
+            {
+                node.World = Nodes[node.Parent].World * node.World;
+                node.UniformScale = node.UniformScale && Nodes[node.Parent].UniformScale;
+            }
+            node.Normal = normalMatrix(node.World, node.UniformScale);
+            updateBounds(i);
+
+            node.Dirty = false;
+            node.Version = mUpdateStamp;
+            ++rebuilt;
+        }
+        mDirtyCount = 0;
+        return rebuilt;
+    }
+
+    // returns the stamp given to nodes rebuilt by the most recent UpdateWorldMatrices call
+    unsigned UpdateStamp() const
+    {
+        return mUpdateStamp;
+    }
+
+private:
+    unsigned mDirtyCount;
+    unsigned mUpdateStamp;
+    std::vector<MeshBounds> mMeshBounds;
+    std::vector<bool> mHasMeshBounds;
+
+    // transforms the mesh bounds of a node by its world matrix. A box keeps its center transformed as a point and
+    // takes the absolute value of the matrix for its extent; the sphere radius grows with the largest axis scale.
+    // Nodes whose mesh has no bounds get an unbounded box so they are never culled
+    void updateBounds(size_t i)
+    {
+        SceneNode& node = Nodes[i];
+        if (node.Mesh >= mMeshBounds.size() || !mHasMeshBounds[node.Mesh])
+        {
+            node.WorldCenter = glm::vec3(node.World[3]);
+            node.WorldRadius = 1e30f;
+            WorldBounds.Set(i, node.WorldCenter, glm::vec3(1e30f));
+            return;
+        }
+
+        const MeshBounds& bounds = mMeshBounds[node.Mesh];
+        glm::mat3 upper(node.World);
+        glm::mat3 absUpper(glm::abs(upper[0]), glm::abs(upper[1]), glm::abs(upper[2]));
+        glm::vec3 boxCenter = glm::vec3(node.World * glm::vec4((bounds.Min + bounds.Max) * 0.5f, 1.0f));
+        WorldBounds.Set(i, boxCenter, absUpper * ((bounds.Max - bounds.Min) * 0.5f));
+
+        float maxScaleSquared = glm::max(glm::dot(upper[0], upper[0]), glm::max(glm::dot(upper[1], upper[1]), glm::dot(upper[2], upper[2])));
+        node.WorldCenter = glm::vec3(node.World * glm::vec4(bounds.SphereCenter, 1.0f));
+        node.WorldRadius = bounds.SphereRadius * sqrtf(maxScaleSquared);
+    }
+
+    // a rotation scaled by s has the inverse transpose R / s = M / s^2, which avoids the general 3x3 inverse
+    static glm::mat3 normalMatrix(const glm::mat4 &world, bool uniformScale)
+    {
+        glm::mat3 upper(world);
+        if (uniformScale)
+        {
+            float scaleSquared = glm::dot(upper[0], upper[0]);
+            return scaleSquared > 0.0f ? upper * (1.0f / scaleSquared) : upper;
+        }
+        return glm::transpose(glm::inverse(upper));
+    }
+
+    void markDirty(int node)
+    {
+        if (!Nodes[node].Dirty)
+        {
+            Nodes[node].Dirty = true;
+            ++mDirtyCount;
+        }
+    }
+};
+#endif
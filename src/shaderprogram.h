@@ -0,0 +1,136 @@
+#ifndef SHADERPROGRAM_H
+#define SHADERPROGRAM_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Uniform block binding point of the per-frame data shared by every program
+const GLuint FRAME_UNIFORM_BINDING = 0;
+// Lights carried by FrameData, the shaders declare their arrays with this size
+const GLuint MAX_FRAME_LIGHTS = 4;
+
+// Per-frame camera and light data, matches the std140 FrameData block declared by the shaders
+struct FrameData
+{
+    glm::mat4 View;
+    glm::mat4 Projection;
+    glm::vec4 ViewPosition;   // xyz used, vec3 is padded to 16 bytes in std140
+    glm::vec4 LightPosition[MAX_FRAME_LIGHTS];
+    glm::vec4 LightColor[MAX_FRAME_LIGHTS];   // black for unused lights
+};
+
+// A linked program together with the locations of its active uniforms, reflected once after linking so that
+// rendering never has to call glGetUniformLocation
+class ShaderProgram
+{
+public:
+    struct Uniform
+    {
+        std::string Name;
+        GLint  Location;
+        GLenum Type;
+        GLint  Size;
+    };
+
+    GLuint Id;
+    std::vector<Uniform> Uniforms;
+
+    ShaderProgram() : Id(0)
+    {
+    }
+
+    // takes ownership of a linked program and records all of its active uniforms and uniform blocks
+    void Reflect(GLuint programId)
+    {
+        Id = programId;
+        Uniforms.clear();
+        mLookup.clear();
+
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(Id, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(Id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(maxLength > 0 ? maxLength : 1);
+
+        for (GLint i = 0; i < count; ++i)
+        {
+            Uniform uniform;
+            GLsizei length = 0;
+            glGetActiveUniform(Id, (GLuint)i, (GLsizei)name.size(), &length, &uniform.Size, &uniform.Type, name.data());
+            uniform.Name.assign(name.data(), length);
+            // arrays are reported as "name[0]", store them under their plain name
+            if (uniform.Name.size() > 3 && uniform.Name.compare(uniform.Name.size() - 3, 3, "[0]") == 0)
+                uniform.Name.resize(uniform.Name.size() - 3);
+            // members of uniform blocks have no location and are reached through the block instead
+            uniform.Location = glGetUniformLocation(Id, uniform.Name.c_str());
+            if (uniform.Location < 0)
+                continue;
+
+            mLookup[uniform.Name] = Uniforms.size();
+            Uniforms.push_back(uniform);
+        }
+
+        // route the per-frame block to its shared binding point
+        GLuint frameBlock = glGetUniformBlockIndex(Id, "FrameData");
+        if (frameBlock != GL_INVALID_INDEX)
+            glUniformBlockBinding(Id, frameBlock, FRAME_UNIFORM_BINDING);
+    }
+
+    // location of an active uniform, or -1 when the program doesn't use it
+    GLint Location(const std::string &name) const
+    {
+        std::unordered_map<std::string, size_t>::const_iterator it = mLookup.find(name);
+        return it == mLookup.end() ? -1 : Uniforms[it->second].Location;
+    }
+
+    bool Has(const std::string &name) const
+    {
+        return mLookup.find(name) != mLookup.end();
+    }
+
+private:
+    std::unordered_map<std::string, size_t> mLookup;
+};
+
+// A uniform buffer holding one T, bound to a fixed binding point and shared by every program that declares it
+template <class T>
+class UniformBuffer
+{
+public:
+    UniformBuffer() : mBuffer(0), mBinding(0)
+    {
+    }
+
+    void Create(GLuint binding)
+    {
+        mBinding = binding;
+        glGenBuffers(1, &mBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, mBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, mBinding, mBuffer);
+    }
+
+    void Destroy()
+    {
+        glDeleteBuffers(1, &mBuffer);
+        mBuffer = 0;
+    }
+
+    // replaces the contents of the buffer, typically once per frame. Binding it to its binding point on the way
+    // restores the binding should other code have replaced it
+    void Update(const T &data)
+    {
+        glBindBufferBase(GL_UNIFORM_BUFFER, mBinding, mBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+private:
+    GLuint mBuffer;
+    GLuint mBinding;
+};
+#endif
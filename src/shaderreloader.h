@@ -0,0 +1,361 @@
+#ifndef SHADERRELOADER_H
+#define SHADERRELOADER_H
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "shadervariants.h"
+
+// Rebuilds programs when their shader files change, without stalling the render loop. A worker thread waits for
+// changes (inotify on Linux, modification times elsewhere), reads the files again and builds the programs on a
+// hidden context sharing objects with the render context, with the same builder that made the running ones.
+// Programs that link come back through Poll once a fence shows the worker's GL commands are done, so the render
+// loop can swap them in between frames. When any program of a source fails to build, none of them are handed back
+// and the running ones stay in use
+class ShaderReloader
+{
+public:
+    // the files of a program, joined in order into its vertex and fragment sources. Masks lists the variants built
+    // from them with ShaderVariants::Specialize, empty for a plain program
+    struct Source
+    {
+        std::vector<std::string> VertexFiles;
+        std::vector<std::string> FragmentFiles;
+        std::vector<uint32_t> Masks;
+    };
+
+    // a rebuilt source. Programs[i] was specialized for Masks[i], or is the only program without masks. The sources
+    // are the joined files before specialization. The receiver owns the programs
+    struct Reload
+    {
+        int Key;
+        std::string VertexSource;
+        std::string FragmentSource;
+        std::vector<uint32_t> Masks;
+        std::vector<GLuint> Programs;
+    };
+
+    ShaderReloader() : mContext(NULL), mBuilder(NULL), mStop(false)
+    {
+    }
+
+    // reads a whole file. Returns false when it can't be opened
+    static bool ReadFile(const std::string &filename, std::string &contents)
+    {
+        std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+        if (!file)
+            return false;
+        std::ostringstream stream;
+        stream << file.rdbuf();
+        contents = stream.str();
+        return true;
+    }
+
+    // starts watching the files of a program and returns the key its reloads carry. Sources added while the worker
+    // runs are watched from its next round, within a quarter of a second
+    int Watch(const Source &source)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mSources.push_back(source);
+        return (int)mSources.size() - 1;
+    }
+
+    // starts the worker on context, a hidden window sharing objects with the render context, rebuilding programs
+    // with builder. The reloader destroys the context in Stop. Call from the main thread, like every other method
+    // but Watch
+    bool Start(GLFWwindow* context, ShaderVariants::ProgramBuilder builder)
+    {
+        if (!context)
+        {
+            std::cout << "ERROR::SHADERRELOADER::NO_CONTEXT, shaders won't be reloaded" << std::endl;
+            return false;
+        }
+        mContext = context;
+        mBuilder = builder;
+        mStop = false;
+        mThread = std::thread(&ShaderReloader::run, this);
+        return true;
+    }
+
+    // stops the worker and deletes programs that were built but never picked up
+    void Stop()
+    {
+        mStop = true;
+        if (mThread.joinable())
+            mThread.join();
+        for (size_t i = 0; i < mReady.size(); ++i)
+        {
+            glDeleteSync(mReady[i].Fence);
+            for (size_t p = 0; p < mReady[i].Result.Programs.size(); ++p)
+                glDeleteProgram(mReady[i].Result.Programs[p]);
+        }
+        mReady.clear();
+        if (mContext)
+            glfwDestroyWindow(mContext);
+        mContext = NULL;
+    }
+
+    // reloads whose programs are ready to use, oldest first. Call at a frame boundary
+    std::vector<Reload> Poll()
+    {
+        std::vector<Reload> reloads;
+        std::lock_guard<std::mutex> lock(mMutex);
+        size_t kept = 0;
+        for (size_t i = 0; i < mReady.size(); ++i)
+        {
+            GLenum status = glClientWaitSync(mReady[i].Fence, 0, 0);
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+            {
+                glDeleteSync(mReady[i].Fence);
+                reloads.push_back(mReady[i].Result);
+            }
+            else
+                mReady[kept++] = mReady[i];
+        }
+        mReady.resize(kept);
+        return reloads;
+    }
+
+private:
+    struct ReadyReload
+    {
+        GLsync Fence;
+        Reload Result;
+    };
+
+    // a watched file split at its last slash, so inotify events can be matched against it
+    struct WatchedFile
+    {
+        std::string Directory;
+        std::string Name;
+        time_t Modified;
+    };
+
+    GLFWwindow* mContext;
+    ShaderVariants::ProgramBuilder mBuilder;
+    std::atomic<bool> mStop;
+    std::thread mThread;
+    std::mutex mMutex;
+    std::vector<Source> mSources;     // guarded by mMutex
+    std::vector<ReadyReload> mReady;  // guarded by mMutex
+
+    static WatchedFile split(const std::string &path)
+    {
+        WatchedFile file;
+        size_t slash = path.find_last_of("/\\");
+        file.Directory = slash == std::string::npos ? "." : path.substr(0, slash);
+        file.Name = slash == std::string::npos ? path : path.substr(slash + 1);
+        file.Modified = modified(path);
+        return file;
+    }
+
+    static time_t modified(const std::string &path)
+    {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 ? info.st_mtime : 0;
+    }
+
+    static std::string join(const WatchedFile &file)
+    {
+        return file.Directory + "/" + file.Name;
+    }
+
+    void run()
+    {
+        glfwMakeContextCurrent(mContext);
+
+        std::vector<WatchedFile> files;
+        size_t watchedSources = 0;
+#ifdef __linux__
+        int notify = inotify_init1(IN_NONBLOCK);
+        std::vector<int> descriptors;
+        std::vector<std::string> directories;
+#endif
+
+        while (!mStop)
+        {
+            // pick up the sources passed to Watch since the last round
+            size_t firstNew = files.size();
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                for (; watchedSources < mSources.size(); ++watchedSources)
+                {
+                    for (size_t i = 0; i < mSources[watchedSources].VertexFiles.size(); ++i)
+                        files.push_back(split(mSources[watchedSources].VertexFiles[i]));
+                    for (size_t i = 0; i < mSources[watchedSources].FragmentFiles.size(); ++i)
+                        files.push_back(split(mSources[watchedSources].FragmentFiles[i]));
+                }
+            }
+#ifdef __linux__
+            // watch the directories rather than the files: editors often save by writing a new file and renaming it
+            for (size_t i = firstNew; i < files.size() && notify >= 0; ++i)
+            {
+                bool known = false;
+                for (size_t d = 0; d < directories.size(); ++d)
+                    known = known || directories[d] == files[i].Directory;
+                if (known)
+                    continue;
+                int descriptor = inotify_add_watch(notify, files[i].Directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+                if (descriptor < 0)
+                    std::cout << "ERROR::SHADERRELOADER::WATCH_FAILED " << files[i].Directory << std::endl;
+                descriptors.push_back(descriptor);
+                directories.push_back(files[i].Directory);
+            }
+#else
+            (void)firstNew;
+#endif
+
+            std::vector<std::string> changed;
+#ifdef __linux__
+            if (notify >= 0)
+                readEvents(notify, descriptors, directories, changed, 100);
+            else
+#endif
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(250));
+                for (size_t i = 0; i < files.size(); ++i)
+                {
+                    time_t time = modified(join(files[i]));
+                    if (time != files[i].Modified)
+                    {
+                        files[i].Modified = time;
+                        changed.push_back(join(files[i]));
+                    }
+                }
+            }
+            if (changed.empty())
+                continue;
+
+#ifdef __linux__
+            // a save can take several writes, wait until the files have been quiet for a moment
+            if (notify >= 0)
+                while (readEvents(notify, descriptors, directories, changed, 50))
+                    ;
+#endif
+            rebuildChanged(changed);
+        }
+
+#ifdef __linux__
+        if (notify >= 0)
+            close(notify);
+#endif
+        glfwMakeContextCurrent(NULL);
+    }
+
+#ifdef __linux__
+    // waits up to timeout milliseconds and appends the paths named by the events read. Returns false on timeout
+    static bool readEvents(int notify, const std::vector<int> &descriptors, const std::vector<std::string> &directories, std::vector<std::string> &changed, int timeout)
+    {
+        pollfd request = { notify, POLLIN, 0 };
+        if (poll(&request, 1, timeout) <= 0)
+            return false;
+
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(notify, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* next = buffer; next < buffer + length; )
+            {
+                const inotify_event* event = (const inotify_event*)next;
+                next += sizeof(inotify_event) + event->len;
+                for (size_t d = 0; d < descriptors.size(); ++d)
+                    if (descriptors[d] == event->wd && event->len > 0)
+                        changed.push_back(directories[d] + "/" + event->name);
+            }
+        }
+        return true;
+    }
+#endif
+
+    void rebuildChanged(const std::vector<std::string> &changed)
+    {
+        std::vector<Source> sources;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            sources = mSources;
+        }
+        for (size_t s = 0; s < sources.size() && !mStop; ++s)
+        {
+            std::vector<std::string> paths = sources[s].VertexFiles;
+            paths.insert(paths.end(), sources[s].FragmentFiles.begin(), sources[s].FragmentFiles.end());
+            bool affected = false;
+            for (size_t p = 0; p < paths.size() && !affected; ++p)
+                for (size_t c = 0; c < changed.size() && !affected; ++c)
+                    affected = join(split(paths[p])) == changed[c];
+            if (affected)
+                rebuild((int)s, sources[s]);
+        }
+    }
+
+    void rebuild(int key, const Source &source)
+    {
+        Reload reload;
+        reload.Key = key;
+        reload.Masks = source.Masks;
+        if (!readAll(source.VertexFiles, reload.VertexSource) || !readAll(source.FragmentFiles, reload.FragmentSource))
+            return;
+
+        bool success = true;
+        size_t count = source.Masks.empty() ? 1 : source.Masks.size();
+        for (size_t i = 0; i < count && success; ++i)
+        {
+            ShaderProgram program;
+            if (source.Masks.empty())
+                success = mBuilder(reload.VertexSource.c_str(), reload.FragmentSource.c_str(), program);
+            else
+                success = mBuilder(ShaderVariants::Specialize(reload.VertexSource, source.Masks[i]).c_str(),
+                    ShaderVariants::Specialize(reload.FragmentSource, source.Masks[i]).c_str(), program);
+            if (success)
+                reload.Programs.push_back(program.Id);
+        }
+        if (!success)
+        {
+            for (size_t i = 0; i < reload.Programs.size(); ++i)
+                glDeleteProgram(reload.Programs[i]);
+            std::cout << "ERROR::SHADERRELOADER::REBUILD_FAILED, keeping the running program" << std::endl;
+            return;
+        }
+
+        // the render context may only use the programs once this context's commands have completed
+        ReadyReload ready = { glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), reload };
+        glFlush();
+        std::lock_guard<std::mutex> lock(mMutex);
+        mReady.push_back(ready);
+        std::cout << "INFO: rebuilt " << reload.Programs.size() << " programs from " << source.FragmentFiles.back() << std::endl;
+    }
+
+    static bool readAll(const std::vector<std::string> &files, std::string &source)
+    {
+        source.clear();
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            std::string contents;
+            if (!ReadFile(files[i], contents))
+            {
+                std::cout << "ERROR::SHADERRELOADER::READ_FAILED " << files[i] << std::endl;
+                return false;
+            }
+            source += contents;
+        }
+        return true;
+    }
+};
+#endif
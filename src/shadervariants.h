@@ -0,0 +1,156 @@
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "shaderprogram.h"
+
+// Features a program can be specialized for. A feature mask ORs these flags with the light count packed by
+// ShaderFeatureMask
+enum ShaderFeature {
+    FEATURE_TEXTURED = 1 << 0,    // the surface color is modulated by the material texture
+    FEATURE_SPECULAR = 1 << 1     // Phong specular highlights are computed
+};
+
+// the light count is stored minus one in the two bits above the flags
+const int FEATURE_LIGHT_SHIFT = 2;
+const uint32_t FEATURE_LIGHT_MASK = 3u << FEATURE_LIGHT_SHIFT;
+
+inline uint32_t ShaderFeatureMask(bool textured, bool specular, uint32_t lightCount)
+{
+    if (lightCount < 1)
+        lightCount = 1;
+    if (lightCount > MAX_FRAME_LIGHTS)
+        lightCount = MAX_FRAME_LIGHTS;
+    uint32_t mask = (lightCount - 1) << FEATURE_LIGHT_SHIFT;
+    if (textured)
+        mask |= FEATURE_TEXTURED;
+    if (specular)
+        mask |= FEATURE_SPECULAR;
+    return mask;
+}
+
+inline uint32_t ShaderFeatureLights(uint32_t mask)
+{
+    return ((mask & FEATURE_LIGHT_MASK) >> FEATURE_LIGHT_SHIFT) + 1;
+}
+
+// Builds one program per feature mask from a single pair of sources. The defines TEXTURED, SPECULAR and
+// LIGHT_COUNT are inserted after the #version line and the shaders test them in constant expressions
+// (if (SPECULAR != 0), loops up to LIGHT_COUNT), which the compiler folds away, so a variant only pays for the
+// features it has. Variants are compiled the first time they are asked for, and can be replaced by programs
+// rebuilt elsewhere (see ShaderReloader)
+class ShaderVariants
+{
+public:
+    // compiles, links and reflects a program
+    typedef bool (*ProgramBuilder)(const char* vertexSource, const char* fragmentSource, ShaderProgram &program);
+    // sets whatever uniforms never change on a freshly built or replaced program. Builders and setups must not bind
+    // anything, variants can be built in the middle of a frame behind the GLStateCache
+    typedef void (*ProgramSetup)(ShaderProgram &program);
+
+    // every mask is below this, which keeps masks within the program field of RenderQueue keys
+    static const uint32_t MaskCount = 16;
+
+    ShaderVariants() : mBuilder(NULL), mSetup(NULL)
+    {
+    }
+
+    void Create(const std::string &vertexSource, const std::string &fragmentSource, ProgramBuilder builder, ProgramSetup setup = NULL)
+    {
+        mVertexSource = vertexSource;
+        mFragmentSource = fragmentSource;
+        mBuilder = builder;
+        mSetup = setup;
+    }
+
+    // sources used by variants built from now on
+    void SetSources(const std::string &vertexSource, const std::string &fragmentSource)
+    {
+        mVertexSource = vertexSource;
+        mFragmentSource = fragmentSource;
+    }
+
+    // takes ownership of a linked program built for mask and deletes the one it replaces
+    void Replace(uint32_t mask, GLuint programId)
+    {
+        ShaderProgram &program = mPrograms[mask & (MaskCount - 1)];
+        glDeleteProgram(program.Id);
+        program.Reflect(programId);
+        if (mSetup)
+            mSetup(program);
+    }
+
+    // program of a feature mask, built on first use. Returns NULL when it fails to build, without trying again
+    const ShaderProgram* Get(uint32_t mask)
+    {
+        mask &= MaskCount - 1;
+        std::unordered_map<uint32_t, ShaderProgram>::iterator it = mPrograms.find(mask);
+        if (it == mPrograms.end())
+        {
+            ShaderProgram &program = mPrograms[mask];
+            std::string vertexSource = Specialize(mVertexSource, mask);
+            std::string fragmentSource = Specialize(mFragmentSource, mask);
+            if (!mBuilder(vertexSource.c_str(), fragmentSource.c_str(), program))
+            {
+                std::cout << "ERROR::SHADERVARIANTS::BUILD_FAILED for feature mask " << mask << std::endl;
+                glDeleteProgram(program.Id);
+                program.Id = 0;
+            }
+            else if (mSetup)
+                mSetup(program);
+            return program.Id ? &program : NULL;
+        }
+        return it->second.Id ? &it->second : NULL;
+    }
+
+    void Destroy()
+    {
+        for (std::unordered_map<uint32_t, ShaderProgram>::iterator it = mPrograms.begin(); it != mPrograms.end(); ++it)
+            glDeleteProgram(it->second.Id);
+        mPrograms.clear();
+    }
+
+    // number of variants built so far
+    size_t Count() const
+    {
+        return mPrograms.size();
+    }
+
+    // masks of the variants built successfully
+    std::vector<uint32_t> Masks() const
+    {
+        std::vector<uint32_t> masks;
+        for (std::unordered_map<uint32_t, ShaderProgram>::const_iterator it = mPrograms.begin(); it != mPrograms.end(); ++it)
+            if (it->second.Id)
+                masks.push_back(it->first);
+        return masks;
+    }
+
+    // source with the defines of a feature mask inserted after its first line, the #version line
+    static std::string Specialize(const std::string &source, uint32_t mask)
+    {
+        std::string defines =
+            "#define TEXTURED " + std::to_string((mask & FEATURE_TEXTURED) ? 1 : 0) + "\n" +
+            "#define SPECULAR " + std::to_string((mask & FEATURE_SPECULAR) ? 1 : 0) + "\n" +
+            "#define LIGHT_COUNT " + std::to_string(ShaderFeatureLights(mask)) + "\n";
+        size_t lineEnd = source.find('\n');
+        if (lineEnd == std::string::npos)
+            return source + "\n" + defines;
+        return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+    }
+
+private:
+    ProgramBuilder mBuilder;
+    ProgramSetup mSetup;
+    std::string mVertexSource;
+    std::string mFragmentSource;
+    std::unordered_map<uint32_t, ShaderProgram> mPrograms;
+};
+#endif
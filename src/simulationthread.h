@@ -0,0 +1,78 @@
+#ifndef SIMULATIONTHREAD_H
+#define SIMULATIONTHREAD_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Runs a tick function on its own thread at a fixed rate, so the simulation advances by exactly one step per tick
+// however long frames take to render. A thread that falls behind runs the missed ticks back to back, up to
+// MaxCatchUpTicks, and then skips ahead so a long stall doesn't turn into a burst of ticks
+class SimulationThread
+{
+public:
+    // advances the simulation by step seconds. time is when the tick was due, in seconds on the Now() clock
+    typedef void (*TickFunction)(double time, float step);
+
+    static const int MaxCatchUpTicks = 5;
+
+    SimulationThread() : mStep(0.0f), mTick(NULL), mStop(false)
+    {
+    }
+
+    void Start(float ticksPerSecond, TickFunction tick)
+    {
+        mStep = 1.0f / ticksPerSecond;
+        mTick = tick;
+        mStop = false;
+        mStart = std::chrono::steady_clock::now();
+        mThread = std::thread(&SimulationThread::run, this);
+    }
+
+    void Stop()
+    {
+        mStop = true;
+        if (mThread.joinable())
+            mThread.join();
+    }
+
+    // seconds per tick
+    float Step() const
+    {
+        return mStep;
+    }
+
+    // seconds since Start, the clock tick times are given on
+    double Now() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+    }
+
+private:
+    float mStep;
+    TickFunction mTick;
+    std::atomic<bool> mStop;
+    std::chrono::steady_clock::time_point mStart;
+    std::thread mThread;
+
+    void run()
+    {
+        typedef std::chrono::steady_clock Clock;
+        const Clock::duration step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(mStep));
+        Clock::time_point next = mStart;
+        while (!mStop)
+        {
+            int ticks = 0;
+            while (next <= Clock::now() && ticks < MaxCatchUpTicks)
+            {
+                mTick(std::chrono::duration<double>(next - mStart).count(), mStep);
+                next += step;
+                ++ticks;
+            }
+            if (next <= Clock::now())
+                next = Clock::now();
+            std::this_thread::sleep_until(next);
+        }
+    }
+};
+#endif
@@ -0,0 +1,221 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <GL/glew.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ddstexture.h"
+#include "glstate.h"
+#include "textureloader.h"
+
+// Shares textures by path and keeps the memory they use under a budget. Every Acquire adds a reference and every
+// Release drops one; textures nobody references stay cached until the budget is exceeded, then the least recently
+// used of them are deleted. Acquiring an evicted path streams it in again. Referenced textures and textures still
+// being loaded are never evicted, so the name returned by Acquire stays valid until the matching Release
+class TextureCache
+{
+public:
+    TextureCache() : mLoader(NULL), mBudget(0), mUsedBytes(0), mClock(0), mOverBudget(false)
+    {
+    }
+
+    // textures that aren't baked are loaded through loader. budgetBytes can be changed later with SetBudget
+    void Create(TextureLoader &loader, size_t budgetBytes)
+    {
+        mLoader = &loader;
+        mBudget = budgetBytes;
+    }
+
+    void SetBudget(size_t budgetBytes)
+    {
+        mBudget = budgetBytes;
+        mOverBudget = false;
+    }
+
+    // returns the texture of a path, loading it when it isn't resident. A baked .dds next to the image is
+    // preferred, otherwise the image is streamed and the texture holds a placeholder until it arrives
+    GLuint Acquire(const std::string &path, GLStateCache &state)
+    {
+        Entry* entry = find(path);
+        if (!entry)
+        {
+            Entry added = { path, 0, 0, 0, 0 };
+            mEntries.push_back(added);
+            entry = &mEntries.back();
+        }
+
+        if (entry->TextureId == 0)
+        {
+            if (LoadDdsTexture(BakedTexturePath(path).c_str(), state, entry->TextureId))
+                measure(*entry);
+            else
+                entry->TextureId = mLoader->Load(path.c_str(), state);
+        }
+        ++entry->References;
+        entry->LastUsed = ++mClock;
+        return entry->TextureId;
+    }
+
+    // drops one reference. Returns false when the texture doesn't belong to the cache
+    bool Release(GLuint textureId)
+    {
+        Entry* entry = find(textureId);
+        if (!entry)
+            return false;
+        if (entry->References > 0)
+            --entry->References;
+        entry->LastUsed = ++mClock;
+        return true;
+    }
+
+    // records the size of textures uploaded since the last frame and evicts until the budget holds again.
+    // Call once per frame after TextureLoader::Update
+    void Update(GLStateCache &state)
+    {
+        const std::vector<GLuint> &uploaded = mLoader->UploadedTextures();
+        for (size_t i = 0; i < uploaded.size(); ++i)
+        {
+            Entry* entry = find(uploaded[i]);
+            if (entry)
+                measure(*entry);
+        }
+        evict(state);
+    }
+
+    // deletes every texture, referenced or not
+    void Clear(GLStateCache &state)
+    {
+        for (size_t i = 0; i < mEntries.size(); ++i)
+            if (mEntries[i].TextureId)
+                deleteTexture(mEntries[i], state);
+        mEntries.clear();
+        mUsedBytes = 0;
+    }
+
+    size_t Budget() const
+    {
+        return mBudget;
+    }
+
+    // estimated bytes used by the resident textures
+    size_t UsedBytes() const
+    {
+        return mUsedBytes;
+    }
+
+    // number of textures currently in GPU memory
+    size_t ResidentCount() const
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < mEntries.size(); ++i)
+            if (mEntries[i].TextureId)
+                ++count;
+        return count;
+    }
+
+private:
+    struct Entry
+    {
+        std::string Path;
+        GLuint   TextureId;    // 0 while evicted
+        unsigned References;
+        size_t   Bytes;        // 0 until the final image has been measured
+        unsigned LastUsed;     // value of mClock at the last Acquire or Release
+    };
+
+    TextureLoader* mLoader;
+    size_t mBudget;
+    size_t mUsedBytes;
+    unsigned mClock;
+    bool mOverBudget;
+    std::vector<Entry> mEntries;
+
+    Entry* find(const std::string &path)
+    {
+        for (size_t i = 0; i < mEntries.size(); ++i)
+            if (mEntries[i].Path == path)
+                return &mEntries[i];
+        return NULL;
+    }
+
+    Entry* find(GLuint textureId)
+    {
+        for (size_t i = 0; i < mEntries.size(); ++i)
+            if (textureId != 0 && mEntries[i].TextureId == textureId)
+                return &mEntries[i];
+        return NULL;
+    }
+
+    // adds up the storage of every mip level as reported by GL. Uncompressed texels are counted as four bytes,
+    // which is how drivers store RGB8
+    void measure(Entry &entry)
+    {
+        size_t bytes = 0;
+        GLint previousTexture = 0;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+        glBindTexture(GL_TEXTURE_2D, entry.TextureId);
+        for (GLint level = 0; ; ++level)
+        {
+            GLint width = 0, height = 0, compressed = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+            if (width == 0 || height == 0)
+                break;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+            if (compressed)
+            {
+                GLint size = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+                bytes += (size_t)size;
+            }
+            else
+                bytes += (size_t)width * height * 4;
+        }
+        // put the binding back so the state cache stays right
+        glBindTexture(GL_TEXTURE_2D, (GLuint)previousTexture);
+
+        mUsedBytes = mUsedBytes - entry.Bytes + bytes;
+        entry.Bytes = bytes;
+    }
+
+    void deleteTexture(Entry &entry, GLStateCache &state)
+    {
+        state.ForgetTexture(entry.TextureId);
+        glDeleteTextures(1, &entry.TextureId);
+        entry.TextureId = 0;
+        mUsedBytes -= entry.Bytes;
+        entry.Bytes = 0;
+    }
+
+    // deletes unreferenced textures, least recently used first, until the resident ones fit the budget
+    void evict(GLStateCache &state)
+    {
+        while (mUsedBytes > mBudget)
+        {
+            Entry* oldest = NULL;
+            for (size_t i = 0; i < mEntries.size(); ++i)
+            {
+                Entry &entry = mEntries[i];
+                if (entry.TextureId == 0 || entry.References > 0 || mLoader->IsPending(entry.TextureId))
+                    continue;
+                if (!oldest || entry.LastUsed < oldest->LastUsed)
+                    oldest = &entry;
+            }
+
+            if (!oldest)
+            {
+                // everything left is in use, report it once until the budget changes or usage drops
+                if (!mOverBudget)
+                    std::cout << "ERROR::TEXTURECACHE::OVER_BUDGET " << mUsedBytes << " bytes referenced, budget is " << mBudget << std::endl;
+                mOverBudget = true;
+                return;
+            }
+            deleteTexture(*oldest, state);
+        }
+        mOverBudget = false;
+    }
+};
+#endif
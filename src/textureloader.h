@@ -0,0 +1,313 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <GL/glew.h>
+#include <stb_image.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glstate.h"
+#include "glsync.h"
+#include "imageflip.h"
+#include "lockfreequeue.h"
+
+// Loads textures without stalling the GL thread. Load() hands out a texture name at once, holding a 1x1
+// placeholder texel, and queues the file for a pool of worker threads that decode it. Decoded images come back
+// through a lock-free queue and Update(), called once per frame on the GL thread, copies them bottom row first into
+// a persistently mapped pixel unpack buffer, which flips them on the way, and redefines the texture from there.
+// Ring space is only reused once the fence of the upload that last read it has signalled
+class TextureLoader
+{
+public:
+    // size of the persistently mapped staging ring
+    static const GLsizeiptr StagingBytes = 64 * 1024 * 1024;
+    // uploads stop for the frame once this many bytes were copied, at least one image always goes through
+    static const size_t MaxUploadBytesPerFrame = 16 * 1024 * 1024;
+
+    TextureLoader() : mDecoded(64), mStop(false), mStagingBuffer(0), mStagingMemory(NULL), mStagingHead(0)
+    {
+    }
+
+    // starts the workers and maps the staging ring. A workerCount of 0 uses every hardware thread but one
+    void Start(unsigned workerCount = 0)
+    {
+        if (workerCount == 0)
+        {
+            unsigned hardwareThreads = std::thread::hardware_concurrency();
+            workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &mStagingBuffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mStagingBuffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, StagingBytes, NULL, flags);
+        mStagingMemory = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, StagingBytes, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!mStagingMemory)
+            std::cout << "ERROR::TEXTURELOADER::STAGING_MAP_FAILED, uploading from client memory" << std::endl;
+
+        mStop = false;
+        for (unsigned i = 0; i < workerCount; ++i)
+            mWorkers.push_back(std::thread(&TextureLoader::work, this));
+    }
+
+    // joins the workers, drops images that were never uploaded and releases the staging ring
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mJobMutex);
+            mStop = true;
+        }
+        mJobReady.notify_all();
+        for (size_t i = 0; i < mWorkers.size(); ++i)
+            mWorkers[i].join();
+        mWorkers.clear();
+        mJobs.clear();
+
+        DecodedImage image;
+        while (mDecoded.TryPop(image))
+            stbi_image_free(image.Pixels);
+        mPendingTextures.clear();
+        mUploaded.clear();
+
+        while (!mFences.empty())
+        {
+            glDeleteSync(mFences.front().Sync);
+            mFences.pop_front();
+        }
+        if (mStagingBuffer)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mStagingBuffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &mStagingBuffer);
+        }
+        mStagingBuffer = 0;
+        mStagingMemory = NULL;
+        mStagingHead = 0;
+    }
+
+    // creates a texture showing the placeholder and queues the file for decoding. Returns the texture name, which
+    // stays valid when the real image arrives
+    GLuint Load(const char* filename, GLStateCache &state)
+    {
+        static const unsigned char placeholder[4] = { 255, 255, 255, 255 };
+
+        GLuint textureId = 0;
+        glGenTextures(1, &textureId);
+        state.BindTextureUnit(0, GL_TEXTURE_2D, textureId);
+        // wrapping and filtering come from the sampler objects in samplers.h
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+
+        Job job;
+        job.Filename = filename;
+        job.TextureId = textureId;
+        {
+            std::lock_guard<std::mutex> lock(mJobMutex);
+            mJobs.push_back(job);
+        }
+        mPendingTextures.push_back(textureId);
+        mJobReady.notify_one();
+        return textureId;
+    }
+
+    // uploads the images decoded since the last call. Must be called on the GL thread
+    void Update(GLStateCache &state)
+    {
+        mUploaded.clear();
+        size_t uploadedBytes = 0;
+        DecodedImage image;
+        while (uploadedBytes < MaxUploadBytesPerFrame && mDecoded.TryPop(image))
+        {
+            for (size_t i = 0; i < mPendingTextures.size(); ++i)
+                if (mPendingTextures[i] == image.TextureId)
+                {
+                    mPendingTextures.erase(mPendingTextures.begin() + i);
+                    break;
+                }
+            if (!image.Pixels)
+            {
+                std::cout << "ERROR::TEXTURELOADER::LOAD_FAILED " << image.Filename << ", keeping the placeholder" << std::endl;
+                continue;
+            }
+            uploadedBytes += upload(image, state);
+            stbi_image_free(image.Pixels);
+            mUploaded.push_back(image.TextureId);
+        }
+    }
+
+    // number of textures still being decoded or waiting for upload
+    unsigned Pending() const
+    {
+        return (unsigned)mPendingTextures.size();
+    }
+
+    // true while the texture still holds its placeholder
+    bool IsPending(GLuint textureId) const
+    {
+        for (size_t i = 0; i < mPendingTextures.size(); ++i)
+            if (mPendingTextures[i] == textureId)
+                return true;
+        return false;
+    }
+
+    // textures that received their image during the last Update
+    const std::vector<GLuint>& UploadedTextures() const
+    {
+        return mUploaded;
+    }
+
+private:
+    struct Job
+    {
+        std::string Filename;
+        GLuint TextureId;
+    };
+
+    struct DecodedImage
+    {
+        std::string Filename;
+        GLuint TextureId;
+        unsigned char* Pixels;   // NULL when decoding failed
+        int Width;
+        int Height;
+        int Channels;
+    };
+
+    // part of the staging ring read by an upload that may still be in flight
+    struct StagingFence
+    {
+        GLsync Sync;
+        GLsizeiptr Begin;
+        GLsizeiptr End;
+    };
+
+    std::vector<std::thread> mWorkers;
+    std::deque<Job> mJobs;
+    std::mutex mJobMutex;
+    std::condition_variable mJobReady;
+    LockFreeQueue<DecodedImage> mDecoded;
+    std::atomic<bool> mStop;
+    // touched by the GL thread only
+    std::vector<GLuint> mPendingTextures;
+    std::vector<GLuint> mUploaded;
+
+    GLuint mStagingBuffer;
+    unsigned char* mStagingMemory;
+    GLsizeiptr mStagingHead;
+    std::deque<StagingFence> mFences;
+
+    // worker loop: decode one file at a time until Stop()
+    void work()
+    {
+        for (;;)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mJobMutex);
+                while (!mStop && mJobs.empty())
+                    mJobReady.wait(lock);
+                if (mStop)
+                    return;
+                job = mJobs.front();
+                mJobs.pop_front();
+            }
+
+            DecodedImage image;
+            image.Filename = job.Filename;
+            image.TextureId = job.TextureId;
+            image.Pixels = stbi_load(job.Filename.c_str(), &image.Width, &image.Height, &image.Channels, 0);
+            if (image.Pixels && image.Channels != 3 && image.Channels != 4)
+            {
+                std::cout << "Not implemented to handle image with " << image.Channels << " channels" << std::endl;
+                stbi_image_free(image.Pixels);
+                image.Pixels = NULL;
+            }
+
+            // the GL thread drains the queue every frame, so a full queue only lasts briefly
+            while (!mDecoded.TryPush(image))
+            {
+                if (mStop)
+                {
+                    stbi_image_free(image.Pixels);
+                    return;
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // reserves size bytes of the staging ring, waiting for earlier uploads still reading that space.
+    // Returns -1 when the image doesn't fit in the ring at all
+    GLsizeiptr allocateStaging(GLsizeiptr size)
+    {
+        if (!mStagingMemory || size > StagingBytes)
+            return -1;
+        if (mStagingHead + size > StagingBytes)
+            mStagingHead = 0;
+
+        // forget uploads that have already finished
+        while (!mFences.empty() && FenceSignalled(mFences.front().Sync))
+        {
+            glDeleteSync(mFences.front().Sync);
+            mFences.pop_front();
+        }
+
+        GLsizeiptr begin = mStagingHead, end = mStagingHead + size;
+        for (;;)
+        {
+            bool overlaps = false;
+            for (size_t i = 0; i < mFences.size() && !overlaps; ++i)
+                overlaps = mFences[i].Begin < end && begin < mFences[i].End;
+            if (!overlaps)
+                break;
+            WaitForFence(mFences.front().Sync);
+            glDeleteSync(mFences.front().Sync);
+            mFences.pop_front();
+        }
+        mStagingHead = end;
+        return begin;
+    }
+
+    // redefines the texture with the decoded image and builds its mipmaps. Returns the number of bytes uploaded
+    size_t upload(const DecodedImage &image, GLStateCache &state)
+    {
+        GLenum format = image.Channels == 4 ? GL_RGBA : GL_RGB;
+        GLenum internalFormat = image.Channels == 4 ? GL_RGBA8 : GL_RGB8;
+        size_t bytes = (size_t)image.Width * image.Height * image.Channels;
+
+        state.BindTextureUnit(0, GL_TEXTURE_2D, image.TextureId);
+        // rows of RGB images aren't padded to four bytes
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        GLsizeiptr offset = allocateStaging((GLsizeiptr)bytes);
+        if (offset >= 0)
+        {
+            copyImageFlipped(mStagingMemory + offset, image.Pixels, image.Width, image.Height, image.Channels);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mStagingBuffer);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.Width, image.Height, 0, format, GL_UNSIGNED_BYTE, (const void*)offset);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            StagingFence fence = { glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), offset, offset + (GLsizeiptr)bytes };
+            mFences.push_back(fence);
+        }
+        else
+        {
+            // no staging space, flip in place and upload from client memory
+            flipImageVertically(image.Pixels, image.Width, image.Height, image.Channels);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.Width, image.Height, 0, format, GL_UNSIGNED_BYTE, image.Pixels);
+        }
+
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        return bytes;
+    }
+};
+#endif
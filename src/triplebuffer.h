@@ -0,0 +1,66 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+// Hands the latest value from one producer thread to one consumer thread without locks or waiting. Of the three
+// slots the producer owns the back one and the consumer the front one; publishing swaps the back slot with the
+// middle one and the consumer swaps its front slot with the middle one when that holds something newer. Neither
+// side ever touches the other's slot, and the consumer always gets the most recent complete value, skipping the
+// ones it was too slow for
+template <class T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : mBack(0), mMiddle(1), mFront(2)
+    {
+    }
+
+    // fills every slot, before either thread starts using the buffer
+    void Reset(const T &value)
+    {
+        for (int i = 0; i < 3; ++i)
+            mSlots[i] = value;
+        mBack = 0;
+        mMiddle.store(1, std::memory_order_relaxed);
+        mFront = 2;
+    }
+
+    // slot the producer writes the next value into
+    T& Back()
+    {
+        return mSlots[mBack];
+    }
+
+    // makes the back slot the newest value and hands the producer a free slot
+    void Publish()
+    {
+        mBack = mMiddle.exchange(mBack | NewBit, std::memory_order_acq_rel) & IndexMask;
+    }
+
+    // takes the newest published value, returns false when nothing was published since the last call
+    bool Update()
+    {
+        if (!(mMiddle.load(std::memory_order_relaxed) & NewBit))
+            return false;
+        mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+
+    // value the consumer reads, stays unchanged until the next Update
+    const T& Front() const
+    {
+        return mSlots[mFront];
+    }
+
+private:
+    static const unsigned IndexMask = 3;
+    static const unsigned NewBit = 4;
+
+    T mSlots[3];
+    // each side's index gets its own cache line
+    alignas(64) unsigned mBack;
+    alignas(64) std::atomic<unsigned> mMiddle;
+    alignas(64) unsigned mFront;
+};
+#endif
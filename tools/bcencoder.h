@@ -0,0 +1,291 @@
+#ifndef BCENCODER_H
+#define BCENCODER_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// CPU encoders for 4x4 blocks of RGBA8 texels (64 bytes, row by row). They favour simplicity over the last bit of
+// quality: endpoints are the extremes of the block's colours projected on their principal axis, and every texel
+// then takes the closest palette entry. Speed doesn't matter much since baking happens offline
+
+namespace bc
+{
+// principal axis of the first `channels` components of the 16 texels, found by power iteration on the
+// covariance matrix. Also returns the mean
+inline void principalAxis(const uint8_t *block, int channels, float mean[4], float axis[4])
+{
+    for (int c = 0; c < 4; ++c)
+        mean[c] = axis[c] = 0.0f;
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < channels; ++c)
+            mean[c] += block[i * 4 + c] / 16.0f;
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int a = 0; a < channels; ++a)
+            for (int b = 0; b < channels; ++b)
+                covariance[a][b] += (block[i * 4 + a] - mean[a]) * (block[i * 4 + b] - mean[b]);
+
+    // start from the diagonal of the bounding box, which is already close for most blocks
+    for (int c = 0; c < channels; ++c)
+    {
+        float low = 255.0f, high = 0.0f;
+        for (int i = 0; i < 16; ++i)
+        {
+            low = block[i * 4 + c] < low ? block[i * 4 + c] : low;
+            high = block[i * 4 + c] > high ? block[i * 4 + c] : high;
+        }
+        axis[c] = high - low + 1e-3f;
+    }
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[4] = {}, length = 0.0f;
+        for (int a = 0; a < channels; ++a)
+        {
+            for (int b = 0; b < channels; ++b)
+                next[a] += covariance[a][b] * axis[b];
+            length += next[a] * next[a];
+        }
+        if (length <= 0.0f)
+            break;
+        length = sqrtf(length);
+        for (int c = 0; c < channels; ++c)
+            axis[c] = next[c] / length;
+    }
+}
+
+// texels with the lowest and highest projection on the principal axis, as colours clamped to [0, 255]
+inline void axisEndpoints(const uint8_t *block, int channels, float low[4], float high[4])
+{
+    float mean[4], axis[4];
+    principalAxis(block, channels, mean, axis);
+    float minimum = 1e30f, maximum = -1e30f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c)
+            t += (block[i * 4 + c] - mean[c]) * axis[c];
+        minimum = t < minimum ? t : minimum;
+        maximum = t > maximum ? t : maximum;
+    }
+    for (int c = 0; c < 4; ++c)
+    {
+        low[c] = c < channels ? mean[c] + axis[c] * minimum : 255.0f;
+        high[c] = c < channels ? mean[c] + axis[c] * maximum : 255.0f;
+        low[c] = low[c] < 0.0f ? 0.0f : (low[c] > 255.0f ? 255.0f : low[c]);
+        high[c] = high[c] < 0.0f ? 0.0f : (high[c] > 255.0f ? 255.0f : high[c]);
+    }
+}
+
+inline uint16_t packRgb565(const float color[4])
+{
+    int r = (int)(color[0] * 31.0f / 255.0f + 0.5f);
+    int g = (int)(color[1] * 63.0f / 255.0f + 0.5f);
+    int b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void unpackRgb565(uint16_t packed, int color[3])
+{
+    color[0] = ((packed >> 11) & 31) * 255 / 31;
+    color[1] = ((packed >> 5) & 63) * 255 / 63;
+    color[2] = (packed & 31) * 255 / 31;
+}
+
+// 8 byte BC1 colour block, always in four colour mode so it can be reused as the colour half of BC3
+inline void EncodeBC1(const uint8_t *block, uint8_t *output)
+{
+    float low[4], high[4];
+    axisEndpoints(block, 3, low, high);
+    uint16_t color0 = packRgb565(high), color1 = packRgb565(low);
+    // four colour mode needs color0 > color1
+    if (color0 < color1)
+    {
+        uint16_t swap = color0;
+        color0 = color1;
+        color1 = swap;
+    }
+
+    int palette[4][3];
+    unpackRgb565(color0, palette[0]);
+    unpackRgb565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 4; ++p)
+            {
+                int error = 0;
+                for (int c = 0; c < 3; ++c)
+                {
+                    int difference = block[i * 4 + c] - palette[p][c];
+                    error += difference * difference;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (i * 2);
+        }
+    }
+
+    output[0] = (uint8_t)(color0 & 0xFF);
+    output[1] = (uint8_t)(color0 >> 8);
+    output[2] = (uint8_t)(color1 & 0xFF);
+    output[3] = (uint8_t)(color1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        output[4 + i] = (uint8_t)(indices >> (i * 8));
+}
+
+// 16 byte BC3 block: an eight step alpha block followed by a BC1 colour block
+inline void EncodeBC3(const uint8_t *block, uint8_t *output)
+{
+    int alpha0 = 0, alpha1 = 255;
+    for (int i = 0; i < 16; ++i)
+    {
+        alpha0 = block[i * 4 + 3] > alpha0 ? block[i * 4 + 3] : alpha0;
+        alpha1 = block[i * 4 + 3] < alpha1 ? block[i * 4 + 3] : alpha1;
+    }
+
+    int palette[8];
+    palette[0] = alpha0;
+    palette[1] = alpha1;
+    for (int p = 1; p < 7; ++p)
+        palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 16 && alpha0 != alpha1; ++i)
+    {
+        int best = 0, bestError = 1 << 30;
+        for (int p = 0; p < 8; ++p)
+        {
+            int error = std::abs(block[i * 4 + 3] - palette[p]);
+            if (error < bestError)
+            {
+                bestError = error;
+                best = p;
+            }
+        }
+        indices |= (uint64_t)best << (i * 3);
+    }
+
+    output[0] = (uint8_t)alpha0;
+    output[1] = (uint8_t)alpha1;
+    for (int i = 0; i < 6; ++i)
+        output[2 + i] = (uint8_t)(indices >> (i * 8));
+    EncodeBC1(block, output + 8);
+}
+
+// appends the low `count` bits of value to a little endian bit stream
+inline void writeBits(uint8_t *output, int &position, uint32_t value, int count)
+{
+    for (int i = 0; i < count; ++i, ++position)
+        if (value & (1u << i))
+            output[position >> 3] |= (uint8_t)(1u << (position & 7));
+}
+
+// 16 byte BC7 block in mode 6: one subset, 7 bit RGBA endpoints with a shared low bit each and 4 bit indices
+inline void EncodeBC7(const uint8_t *block, uint8_t *output)
+{
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    float endpoints[2][4];
+    axisEndpoints(block, 4, endpoints[0], endpoints[1]);
+
+    // quantize each endpoint to 7 bits per channel plus a p-bit, keeping whichever p-bit comes closer
+    int quantized[2][4], pBits[2];
+    for (int e = 0; e < 2; ++e)
+    {
+        int bestError = 1 << 30;
+        for (int p = 0; p < 2; ++p)
+        {
+            int candidate[4], error = 0;
+            for (int c = 0; c < 4; ++c)
+            {
+                int q = (int)((endpoints[e][c] - p) / 2.0f + 0.5f);
+                candidate[c] = q < 0 ? 0 : (q > 127 ? 127 : q);
+                int difference = (int)endpoints[e][c] - ((candidate[c] << 1) | p);
+                error += difference * difference;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pBits[e] = p;
+                memcpy(quantized[e], candidate, sizeof(candidate));
+            }
+        }
+    }
+
+    int palette[16][4];
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 4; ++c)
+        {
+            int low = (quantized[0][c] << 1) | pBits[0], high = (quantized[1][c] << 1) | pBits[1];
+            palette[i][c] = ((64 - weights[i]) * low + weights[i] * high + 32) >> 6;
+        }
+
+    int indices[16];
+    for (int i = 0; i < 16; ++i)
+    {
+        int best = 0, bestError = 1 << 30;
+        for (int p = 0; p < 16; ++p)
+        {
+            int error = 0;
+            for (int c = 0; c < 4; ++c)
+            {
+                int difference = block[i * 4 + c] - palette[p][c];
+                error += difference * difference;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                best = p;
+            }
+        }
+        indices[i] = best;
+    }
+
+    // the first index is stored without its top bit, which must be zero: swap the endpoints when it isn't
+    if (indices[0] & 8)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            int swap = quantized[0][c];
+            quantized[0][c] = quantized[1][c];
+            quantized[1][c] = swap;
+        }
+        int swap = pBits[0];
+        pBits[0] = pBits[1];
+        pBits[1] = swap;
+        for (int i = 0; i < 16; ++i)
+            indices[i] = 15 - indices[i];
+    }
+
+    memset(output, 0, 16);
+    int position = 0;
+    writeBits(output, position, 1u << 6, 7);   // mode 6
+    for (int c = 0; c < 4; ++c)
+    {
+        writeBits(output, position, (uint32_t)quantized[0][c], 7);
+        writeBits(output, position, (uint32_t)quantized[1][c], 7);
+    }
+    writeBits(output, position, (uint32_t)pBits[0], 1);
+    writeBits(output, position, (uint32_t)pBits[1], 1);
+    writeBits(output, position, (uint32_t)indices[0], 3);
+    for (int i = 1; i < 16; ++i)
+        writeBits(output, position, (uint32_t)indices[i], 4);
+}
+}
+#endif
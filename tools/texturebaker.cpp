@@ -0,0 +1,198 @@
+// Offline texture baker. Converts source images (JPEG, PNG, ...) into DDS files holding a full, block compressed
+// mip chain that the project uploads directly with glCompressedTexImage2D, skipping decoding and glGenerateMipmap.
+//
+// Usage: texturebaker [--bc1 | --bc3 | --bc7] [-o <output directory>] <image>...
+//   By default opaque images become BC1 and images with transparency BC3; --bc7 trades size for quality.
+//   Each output is written next to its source with a .dds extension, or into the output directory.
+// Build: g++ -O2 -std=c++11 -I../src -I<stb include dir> texturebaker.cpp -o texturebaker
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>      // Image loading Utility functions
+
+#include "ddsformat.h"
+#include "bcencoder.h"
+
+using namespace std;
+
+namespace
+{
+// One RGBA8 image of the mip chain
+struct MipLevel
+{
+    uint32_t Width;
+    uint32_t Height;
+    vector<uint8_t> Pixels;
+};
+
+// halves an image with a 2x2 box filter, odd edges reuse their last row or column
+MipLevel UDownsample(const MipLevel &source)
+{
+    MipLevel level;
+    level.Width = source.Width > 1 ? source.Width / 2 : 1;
+    level.Height = source.Height > 1 ? source.Height / 2 : 1;
+    level.Pixels.resize((size_t)level.Width * level.Height * 4);
+    for (uint32_t y = 0; y < level.Height; ++y)
+        for (uint32_t x = 0; x < level.Width; ++x)
+        {
+            uint32_t x0 = std::min(x * 2, source.Width - 1), x1 = std::min(x * 2 + 1, source.Width - 1);
+            uint32_t y0 = std::min(y * 2, source.Height - 1), y1 = std::min(y * 2 + 1, source.Height - 1);
+            for (int c = 0; c < 4; ++c)
+            {
+                int sum = source.Pixels[((size_t)y0 * source.Width + x0) * 4 + c] + source.Pixels[((size_t)y0 * source.Width + x1) * 4 + c]
+                        + source.Pixels[((size_t)y1 * source.Width + x0) * 4 + c] + source.Pixels[((size_t)y1 * source.Width + x1) * 4 + c];
+                level.Pixels[((size_t)y * level.Width + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    return level;
+}
+
+// compresses one level block by block. Blocks hanging over the edge repeat the last row and column
+vector<uint8_t> UCompress(const MipLevel &level, BlockFormat format)
+{
+    vector<uint8_t> output(BlockLevelBytes(format, level.Width, level.Height));
+    uint8_t block[64];
+    size_t offset = 0;
+    for (uint32_t by = 0; by < level.Height; by += 4)
+        for (uint32_t bx = 0; bx < level.Width; bx += 4)
+        {
+            for (uint32_t y = 0; y < 4; ++y)
+                for (uint32_t x = 0; x < 4; ++x)
+                {
+                    uint32_t sx = std::min(bx + x, level.Width - 1), sy = std::min(by + y, level.Height - 1);
+                    memcpy(block + (y * 4 + x) * 4, &level.Pixels[((size_t)sy * level.Width + sx) * 4], 4);
+                }
+
+            if (format == BLOCK_BC1)
+                bc::EncodeBC1(block, &output[offset]);
+            else if (format == BLOCK_BC3)
+                bc::EncodeBC3(block, &output[offset]);
+            else
+                bc::EncodeBC7(block, &output[offset]);
+            offset += BlockBytes(format);
+        }
+    return output;
+}
+
+bool UWriteDds(const string &filename, const vector<MipLevel> &levels, const vector<vector<uint8_t> > &blocks, BlockFormat format)
+{
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (!file)
+        return false;
+
+    DdsHeader header;
+    memset(&header, 0, sizeof(header));
+    header.Size = sizeof(DdsHeader);
+    header.Flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.Height = levels[0].Height;
+    header.Width = levels[0].Width;
+    header.PitchOrLinearSize = (uint32_t)blocks[0].size();
+    header.MipMapCount = (uint32_t)levels.size();
+    header.PixelFormat.Size = sizeof(DdsPixelFormat);
+    header.PixelFormat.Flags = DDPF_FOURCC;
+    header.PixelFormat.FourCC = format == BLOCK_BC1 ? DDS_FOURCC_DXT1 : (format == BLOCK_BC3 ? DDS_FOURCC_DXT5 : DDS_FOURCC_DX10);
+    header.Caps = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+
+    bool written = fwrite(&DDS_MAGIC, sizeof(DDS_MAGIC), 1, file) == 1 && fwrite(&header, sizeof(header), 1, file) == 1;
+    if (format == BLOCK_BC7)
+    {
+        DdsHeaderDx10 extension = { DXGI_FORMAT_BC7_UNORM, DDS_DIMENSION_TEXTURE2D, 0, 1, 0 };
+        written = written && fwrite(&extension, sizeof(extension), 1, file) == 1;
+    }
+    for (size_t i = 0; i < blocks.size(); ++i)
+        written = written && fwrite(blocks[i].data(), 1, blocks[i].size(), file) == blocks[i].size();
+    return fclose(file) == 0 && written;
+}
+
+// bakes one image. forcedFormat is used unless it is negative, in which case BC1 or BC3 is picked from the alpha
+bool UBake(const string &input, const string &outputDirectory, int forcedFormat)
+{
+    int width, height, channels;
+    unsigned char* image = stbi_load(input.c_str(), &width, &height, &channels, 4);
+    if (!image)
+    {
+        cout << "ERROR::TEXTUREBAKER::LOAD_FAILED " << input << ": " << stbi_failure_reason() << endl;
+        return false;
+    }
+
+    // rows are stored bottom first, the orientation OpenGL expects
+    vector<MipLevel> levels(1);
+    levels[0].Width = (uint32_t)width;
+    levels[0].Height = (uint32_t)height;
+    levels[0].Pixels.resize((size_t)width * height * 4);
+    for (int y = 0; y < height; ++y)
+        memcpy(&levels[0].Pixels[(size_t)y * width * 4], image + (size_t)(height - 1 - y) * width * 4, (size_t)width * 4);
+    stbi_image_free(image);
+
+    bool translucent = false;
+    for (size_t i = 3; i < levels[0].Pixels.size() && !translucent; i += 4)
+        translucent = levels[0].Pixels[i] != 255;
+    BlockFormat format = forcedFormat >= 0 ? (BlockFormat)forcedFormat : (translucent ? BLOCK_BC3 : BLOCK_BC1);
+
+    while (levels.back().Width > 1 || levels.back().Height > 1)
+        levels.push_back(UDownsample(levels.back()));
+
+    vector<vector<uint8_t> > blocks;
+    size_t totalBytes = 0;
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        blocks.push_back(UCompress(levels[i], format));
+        totalBytes += blocks.back().size();
+    }
+
+    string output = BakedTexturePath(input);
+    if (!outputDirectory.empty())
+    {
+        size_t slash = output.find_last_of("/\\");
+        output = outputDirectory + "/" + (slash == string::npos ? output : output.substr(slash + 1));
+    }
+    if (!UWriteDds(output, levels, blocks, format))
+    {
+        cout << "ERROR::TEXTUREBAKER::WRITE_FAILED " << output << endl;
+        return false;
+    }
+
+    static const char* const formatNames[] = { "BC1", "BC3", "BC7" };
+    cout << "INFO: " << input << " -> " << output << " (" << width << "x" << height << ", " << levels.size() << " levels, "
+         << formatNames[format] << ", " << totalBytes << " bytes)" << endl;
+    return true;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    int forcedFormat = -1;
+    string outputDirectory;
+    vector<string> inputs;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--bc1") == 0)
+            forcedFormat = BLOCK_BC1;
+        else if (strcmp(argv[i], "--bc3") == 0)
+            forcedFormat = BLOCK_BC3;
+        else if (strcmp(argv[i], "--bc7") == 0)
+            forcedFormat = BLOCK_BC7;
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            outputDirectory = argv[++i];
+        else
+            inputs.push_back(argv[i]);
+    }
+
+    if (inputs.empty())
+    {
+        cout << "Usage: texturebaker [--bc1 | --bc3 | --bc7] [-o <output directory>] <image>..." << endl;
+        return EXIT_FAILURE;
+    }
+
+    bool succeeded = true;
+    for (size_t i = 0; i < inputs.size(); ++i)
+        succeeded = UBake(inputs[i], outputDirectory, forcedFormat) && succeeded;
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}